@@ -0,0 +1,378 @@
+/*
+Compiler of user warp formulas: recursive descent parser emitting a stack machine program.
+
+Jingcong Zhang
+jingcoz@g.clemson.edu
+*/
+
+# include <cmath>
+# include <cstdlib>
+# include <cctype>
+
+# include "expression.h"
+
+using namespace std;
+
+
+// functions of one and two arguments
+struct Function1
+{
+  const char *name;
+  double (*f)(double);
+};
+struct Function2
+{
+  const char *name;
+  double (*f)(double, double);
+};
+static const Function1 functions1[] =
+{
+  {"sin", [](double a) {return sin(a);}},   {"cos", [](double a) {return cos(a);}},
+  {"tan", [](double a) {return tan(a);}},   {"asin", [](double a) {return asin(a);}},
+  {"acos", [](double a) {return acos(a);}}, {"atan", [](double a) {return atan(a);}},
+  {"sinh", [](double a) {return sinh(a);}}, {"cosh", [](double a) {return cosh(a);}},
+  {"tanh", [](double a) {return tanh(a);}}, {"sqrt", [](double a) {return sqrt(a);}},
+  {"exp", [](double a) {return exp(a);}},   {"log", [](double a) {return log(a);}},
+  {"abs", [](double a) {return fabs(a);}},  {"floor", [](double a) {return floor(a);}},
+  {"ceil", [](double a) {return ceil(a);}}
+};
+static const Function2 functions2[] =
+{
+  {"pow", [](double a, double b) {return pow(a, b);}},
+  {"atan2", [](double a, double b) {return atan2(a, b);}},
+  {"min", [](double a, double b) {return fmin(a, b);}},
+  {"max", [](double a, double b) {return fmax(a, b);}},
+  {"fmod", [](double a, double b) {return fmod(a, b);}}
+};
+static double (*const sqrt_f)(double) = functions1[9].f;
+static double (*const pow_f)(double, double) = functions2[0].f;
+
+
+Expression::Expression()
+{
+  depth = 0;
+  max_depth = 0;
+  pos = 0;
+}
+
+
+bool Expression::compile(const string &text, const vector<string> &variables, string &error)
+{
+  source = text;
+  names = variables;
+  program.clear();
+  used.assign(variables.size(), false);
+  depth = 0;
+  max_depth = 0;
+  pos = 0;
+  message = "";
+
+  bool ok = parseSum();
+  skipSpace();
+  if (ok and pos < source.size())  {ok = fail("unexpected '" + source.substr(pos, 1) + "'");}
+  if (ok and max_depth > MAX_DEPTH)  {ok = fail("formula nested too deep");}
+  if (!ok)
+  {
+    error = message;
+    program.clear();
+    return false;
+  }
+  return true;
+}
+
+
+double Expression::eval(const double *values) const
+{
+  double stack[MAX_DEPTH];
+  int top = -1;
+  for (size_t i = 0; i < program.size(); i++)
+  {
+    const Op &op = program[i];
+    switch (op.code)
+    {
+      case PUSH:
+        stack[++top] = op.value;
+        break;
+      case LOAD:
+        stack[++top] = values[op.index];
+        break;
+      case ADD:
+        top--;
+        stack[top] += stack[top + 1];
+        break;
+      case SUB:
+        top--;
+        stack[top] -= stack[top + 1];
+        break;
+      case MUL:
+        top--;
+        stack[top] *= stack[top + 1];
+        break;
+      case DIV:
+        top--;
+        stack[top] /= stack[top + 1];
+        break;
+      case NEG:
+        stack[top] = -stack[top];
+        break;
+      case SQUARE:
+        stack[top] *= stack[top];
+        break;
+      case CALL1:
+        stack[top] = op.f1(stack[top]);
+        break;
+      case CALL2:
+        top--;
+        stack[top] = op.f2(stack[top], stack[top + 1]);
+        break;
+    }
+  }
+  return (top == 0) ? stack[0] : 0;
+}
+
+
+bool Expression::uses(int variable) const {return variable >= 0 and variable < int(used.size()) and used[variable];}
+
+
+/*
+parser: one function per precedence level, each emits the program of what it parsed
+  sum     = product {("+" | "-") product}
+  product = unary {("*" | "/") unary}
+  unary   = "-" unary | power
+  power   = primary ["^" unary]
+  primary = number | constant | variable | function "(" sum {"," sum} ")" | "(" sum ")"
+*/
+void Expression::skipSpace()
+{
+  while (pos < source.size() and isspace((unsigned char)source[pos]))  {pos++;}
+}
+
+
+bool Expression::accept(char c)
+{
+  skipSpace();
+  if (pos < source.size() and source[pos] == c) {pos++;  return true;}
+  return false;
+}
+
+
+bool Expression::fail(const string &what)
+{
+  if (message == "")  {message = what + " at column " + to_string(pos + 1) + " of \"" + source + "\"";}
+  return false;
+}
+
+
+bool Expression::parseSum()
+{
+  if (!parseProduct())  {return false;}
+  while (true)
+  {
+    if (accept('+')) {if (!parseProduct()) {return false;}  emitOp(ADD);}
+    else if (accept('-')) {if (!parseProduct()) {return false;}  emitOp(SUB);}
+    else  {return true;}
+  }
+}
+
+
+bool Expression::parseProduct()
+{
+  if (!parseUnary())  {return false;}
+  while (true)
+  {
+    if (accept('*')) {if (!parseUnary()) {return false;}  emitOp(MUL);}
+    else if (accept('/')) {if (!parseUnary()) {return false;}  emitOp(DIV);}
+    else  {return true;}
+  }
+}
+
+
+bool Expression::parseUnary()
+{
+  if (accept('-')) {if (!parseUnary()) {return false;}  emitOp(NEG);  return true;}
+  if (accept('+'))  {return parseUnary();}
+  return parsePower();
+}
+
+
+bool Expression::parsePower()
+{
+  if (!parsePrimary())  {return false;}
+  if (!accept('^'))  {return true;}
+  // x ^ 2 and x ^ 0.5 run as a product and a square root
+  size_t exponent = program.size();
+  if (!parseUnary())  {return false;}
+  if (program.size() == exponent + 1 and program.back().code == PUSH)
+  {
+    double e = program.back().value;
+    if (e == 2 or e == 0.5)
+    {
+      program.pop_back();
+      depth--;
+      if (e == 2) {emitOp(SQUARE);}
+      else  {emitCall1(sqrt_f);}
+      return true;
+    }
+  }
+  emitCall2(pow_f);
+  return true;
+}
+
+
+bool Expression::parsePrimary()
+{
+  skipSpace();
+  if (pos >= source.size())  {return fail("missing operand");}
+  if (accept('('))
+  {
+    if (!parseSum())  {return false;}
+    if (!accept(')'))  {return fail("missing ')'");}
+    return true;
+  }
+
+  const char *start = source.c_str() + pos;
+  if (isdigit((unsigned char)*start) or *start == '.')
+  {
+    char *end;
+    double value = strtod(start, &end);
+    if (end == start)  {return fail("bad number");}
+    pos += end - start;
+    emitPush(value);
+    return true;
+  }
+
+  if (!isalpha((unsigned char)*start) and *start != '_')  {return fail("unexpected '" + string(1, *start) + "'");}
+  size_t end = pos;
+  while (end < source.size() and (isalnum((unsigned char)source[end]) or source[end] == '_'))  {end++;}
+  string name = source.substr(pos, end - pos);
+  pos = end;
+
+  // function call
+  if (accept('('))
+  {
+    vector<double (*)(double)> f1;
+    for (size_t i = 0; i < sizeof(functions1) / sizeof(functions1[0]); i++)
+      {if (name == functions1[i].name) {f1.push_back(functions1[i].f);}}
+    vector<double (*)(double, double)> f2;
+    for (size_t i = 0; i < sizeof(functions2) / sizeof(functions2[0]); i++)
+      {if (name == functions2[i].name) {f2.push_back(functions2[i].f);}}
+    if (f1.empty() and f2.empty())  {return fail("unknown function " + name);}
+
+    int arguments = 0;
+    do
+    {
+      if (!parseSum())  {return false;}
+      arguments++;
+    } while (accept(','));
+    if (!accept(')'))  {return fail("missing ')'");}
+    if (!f1.empty() and arguments == 1) {emitCall1(f1[0]);  return true;}
+    if (!f2.empty() and arguments == 2)
+    {
+      // pow with the exponents 2 and 0.5, as for ^
+      if (f2[0] == pow_f and program.back().code == PUSH and (program.back().value == 2 or program.back().value == 0.5))
+      {
+        double e = program.back().value;
+        program.pop_back();
+        depth--;
+        if (e == 2) {emitOp(SQUARE);}
+        else  {emitCall1(sqrt_f);}
+        return true;
+      }
+      emitCall2(f2[0]);
+      return true;
+    }
+    return fail(name + " takes " + (f1.empty() ? "2 arguments" : "1 argument"));
+  }
+
+  // constant or variable
+  for (size_t i = 0; i < names.size(); i++)
+  {
+    if (name == names[i])
+    {
+      Op op = Op();
+      op.code = LOAD;
+      op.index = i;
+      used[i] = true;
+      emit(op, 0);
+      return true;
+    }
+  }
+  if (name == "pi") {emitPush(M_PI);  return true;}
+  if (name == "e") {emitPush(M_E);  return true;}
+  string known;
+  for (size_t i = 0; i < names.size(); i++)  {known += (i ? ", " : "") + names[i];}
+  return fail("unknown variable " + name + " (variables: " + known + ")");
+}
+
+
+/*
+append an operation that takes pops values off the stack and pushes its result
+  an operation on constants only is folded: its operands are replaced by its value
+*/
+void Expression::emit(const Op &op, int pops)
+{
+  bool constant = (op.code != PUSH and op.code != LOAD and int(program.size()) >= pops);
+  for (int i = 1; i <= pops and constant; i++)  {constant = (program[program.size() - i].code == PUSH);}
+  if (constant)
+  {
+    double a = program[program.size() - pops].value;
+    double b = (pops == 2) ? program.back().value : 0;
+    double value = 0;
+    switch (op.code)
+    {
+      case ADD:  value = a + b;  break;
+      case SUB:  value = a - b;  break;
+      case MUL:  value = a * b;  break;
+      case DIV:  value = a / b;  break;
+      case NEG:  value = -a;  break;
+      case SQUARE:  value = a * a;  break;
+      case CALL1:  value = op.f1(a);  break;
+      case CALL2:  value = op.f2(a, b);  break;
+      default:  break;
+    }
+    program.resize(program.size() - pops);
+    depth -= pops;
+    emitPush(value);
+    return;
+  }
+  program.push_back(op);
+  depth += 1 - pops;
+  max_depth = max(max_depth, depth);
+}
+
+
+void Expression::emitPush(double value)
+{
+  Op op = Op();
+  op.code = PUSH;
+  op.value = value;
+  program.push_back(op);
+  depth++;
+  max_depth = max(max_depth, depth);
+}
+
+
+void Expression::emitOp(OpCode code)
+{
+  Op op = Op();
+  op.code = code;
+  emit(op, (code == NEG or code == SQUARE) ? 1 : 2);
+}
+
+
+void Expression::emitCall1(double (*f)(double))
+{
+  Op op = Op();
+  op.code = CALL1;
+  op.f1 = f;
+  emit(op, 1);
+}
+
+
+void Expression::emitCall2(double (*f)(double, double))
+{
+  Op op = Op();
+  op.code = CALL2;
+  op.f2 = f;
+  emit(op, 2);
+}
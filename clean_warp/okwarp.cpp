@@ -1,18 +1,21 @@
 /*
 OpenGL and GLUT program to warp an input image using inverse mapping from two different warp functions, 
-with fixing the minification using adaptive supersampling and magnification problems using bilinear interpolation, 
+with fixing the minification using adaptive supersampling and magnification problems using bilinear interpolation,
+or filtering both with a mipmap of the input image,
 display the input image and output image, and then optionally write out to an image file.
 Users can select warp mode to decide methods taken to clean the warp and warp functions by command lines.
 
 Usage: 
   okwarp input_image_name [output_image_name]
-    -m mode selection: 0-4
+    -m mode selection: 0-5
     -w warp function selection: 0-1
+    -u formula -v formula: user warp function of x, y, r, a
   mode selection:
     1: general warp
     2: warp with clean method supersampling for minification
     3: warp with clean method adaptive supersampling for minification
     4: warp with clean method bilinear interpolation for magnification
+    5: warp with clean method mipmap filtering for minification and magnification
     0: all clean warp (adaptive supersampling + bilinear interpolation)
     default mode: 0
   warp function selection:
@@ -41,6 +44,8 @@ jingcoz@g.clemson.edu
 # include <math.h>
 # include <cmath>
 # include <iomanip>
+# include <vector>
+# include <functional>
 
 # ifdef __APPLE__
 #   pragma clang diagnostic ignored "-Wdeprecated-declarations"
@@ -49,12 +54,16 @@ jingcoz@g.clemson.edu
 #   include <GL/glut.h>
 # endif
 
+# include "expression.h"
+
 # ifndef PI
 # define PI 3.1415926536
 # endif
 
 # define SAMPLING_TH 65 // predefined adaptive supersampling threshold, 
                         // decided from the difference between each samples and their average when testing
+# define TEXEL_TILE 32    // width and height of the tiles of the supersampled texel caches
+# define MAX_ANISOTROPY 8 // most mipmap probes along the long side of an output pixel footprint
 
 using namespace std;
 OIIO_NAMESPACE_USING
@@ -65,7 +74,112 @@ static unsigned char *outputpixmap; // output image pixels pixmap
 static int xres, yres;  // input image size: width, height
 static int xres_out, yres_out;  // output image size: width, height
 int mode;
-int warp_id;  // warp function 0: dr. house's okwarp function, 1: my warp function
+int warp_id;  // warp function 0: dr. house's okwarp function, 1: my warp function, 2: user formulas
+
+// one level of the mipmap of the input image, each level halves the size of the level before it
+struct MipLevel
+{
+  int width, height;
+  vector<unsigned char> pixels;  // RGBA texels, empty for level 0 which is inputpixmap itself
+  const unsigned char *texels() const {return pixels.empty() ? inputpixmap : &pixels[0];}
+};
+static vector<MipLevel> mipmap;  // levels built so far, a level is built when a lookup first needs it
+
+
+/*
+inverse warp functions: normalized output coordinate (x, y) to normalized input coordinate (u, v),
+map() gives (u, v) and inverse() also the derivatives du/dx and dv/dy
+  u only depends on x and v only on y, so the other two derivatives are 0
+  separable() is true for the warps where that always holds
+*/
+// dr.house's warp function
+struct HouseWarp
+{
+  void setup() {}
+  bool separable() const {return true;}
+  void map(double x, double y, double &u, double &v) const
+  {
+    u = sqrt(x);			        // inverse in x direction is sqrt
+    v = 0.5 * (1 + sin(y * PI));  // inverse in y direction is offset sine
+  }
+  void inverse(float x, float y, float &u, float &v, double &du_dx, double &dv_dy) const
+  {
+    double uu, vv;
+    map(x, y, uu, vv);
+    u = uu;
+    v = vv;
+    du_dx = 0.5 / u;
+    dv_dy = 0.5 * PI * cos(y * PI);
+  }
+};
+
+// my warp function
+struct PowerSineWarp
+{
+  void setup() {}
+  bool separable() const {return true;}
+  void map(double x, double y, double &u, double &v) const
+  {
+    u = pow(x, 0.7);
+    v = pow((sin(M_PI * y / 2)), 2.0);
+  }
+  void inverse(float x, float y, float &u, float &v, double &du_dx, double &dv_dy) const
+  {
+    double uu, vv;
+    map(x, y, uu, vv);
+    u = uu;
+    v = vv;
+    du_dx = 0.7 * u / x;
+    dv_dy = 0.5 * M_PI * sin(M_PI * y);  // 2 sin(a) cos(a) = sin(2a)
+  }
+};
+
+// user formulas of u and v, over x, y and the polar coordinates r, a of (2x - 1, 2y - 1)
+// the derivatives of inverse() are differences across the output pixel, clamped to the image, five maps, so inverse() only
+// builds the tables of a separable formula; other formulas are mapped once per pixel by PixelMap
+struct ExpressionWarp
+{
+  Expression u_formula, v_formula;
+  bool polar;  // r and a are only computed for formulas that read them
+  double step_x, step_y;  // half an output pixel
+
+  void setup()
+  {
+    polar = u_formula.uses(2) or u_formula.uses(3) or v_formula.uses(2) or v_formula.uses(3);
+    step_x = 0.5 / xres_out;
+    step_y = 0.5 / yres_out;
+  }
+  bool separable() const {return !polar and !u_formula.uses(1) and !v_formula.uses(0);}
+  void map(double x, double y, double &u, double &v) const
+  {
+    double values[4] = {x, y, 0, 0};
+    if (polar)
+    {
+      double xx = (x - 0.5) * 2;
+      double yy = (y - 0.5) * 2;
+      values[2] = sqrt(xx * xx + yy * yy);
+      values[3] = atan2(yy, xx);
+    }
+    u = u_formula.eval(values);
+    v = v_formula.eval(values);
+  }
+  void inverse(float x, float y, float &u, float &v, double &du_dx, double &dv_dy) const
+  {
+    double uu, vv, u0, v0, u1, v1;
+    map(x, y, uu, vv);
+    u = uu;
+    v = vv;
+    // the samples stay inside the image, the difference is one-sided on its border
+    double x0 = max(x - step_x, 0.0), x1 = min(x + step_x, 1.0);
+    double y0 = max(y - step_y, 0.0), y1 = min(y + step_y, 1.0);
+    map(x0, y, u0, v0);
+    map(x1, y, u1, v1);
+    du_dx = (u1 - u0) / (x1 - x0);
+    map(x, y0, u0, v0);
+    map(x, y1, u1, v1);
+    dv_dy = (v1 - v0) / (y1 - y0);
+  }
+};
 
 
 /*
@@ -79,28 +193,23 @@ int warp_id;  // warp function 0: dr. house's okwarp function, 1: my warp functi
  
   inwidth and inheight are the input image dimensions
   outwidth and outheight are the output image dimensions
+
+  Also returns the scale factor of the output pixel:
+  the derivatives du/dx and dv/dy of the warp in input pixels per output pixel
+    scale_factor > 1: minification
+    scale_factor < 1: magnification
 */
-void inv_map(float x, float y, float &u, float &v, int inwidth, int inheight, int outwidth, int outheight)
+template <class Warp>
+inline void inv_map(const Warp &warp, float x, float y, float &u, float &v, int inwidth, int inheight, int outwidth, int outheight,
+                    double &scale_factor_x, double &scale_factor_y)
 {  
   x /= outwidth;		// normalize (x, y) to (0...1, 0...1)
   y /= outheight;
 
-  switch (warp_id)
-  {
-    // dr.house's warp function
-    case 0:
-      u = sqrt(x);			        // inverse in x direction is sqrt
-      v = 0.5 * (1 + sin(y * PI));  // inverse in y direction is offset sine
-      break;
-    // my warp function
-    case 1:
-      u = pow(x, 0.7);
-      v = pow((sin(M_PI * y / 2)), 2.0);
-      break;
-    default:
-      cout << "please select warp function between 0-1." << endl;
-      exit(0);
-  }
+  double du_dx, dv_dy;  // derivatives of the normalized map
+  warp.inverse(x, y, u, v, du_dx, dv_dy);
+  scale_factor_x = du_dx * inwidth / outwidth;
+  scale_factor_y = dv_dy * inheight / outheight;
 
   u *= inwidth;			// scale normalized (u, v) to pixel coords
   v *= inheight;
@@ -111,31 +220,20 @@ void inv_map(float x, float y, float &u, float &v, int inwidth, int inheight, in
 
 
 /*
-scale factor calculator
-  scale_factor > 1: minification
-  scale_factor < 1: magnification
+texels of an input image sized pixmap
 */
-void scale_factor(double x, double y, double &scale_factor_x, double &scale_factor_y)
-{
-  // calculate four corners of one output pixel value in the input image
-  // in order to calculate scale factor in each direction (x direction and y direction)
-  float u0, v0, u1, v1, u2, v2, u3, v3;
-  inv_map(x - 0.5, y - 0.5, u0, v0, xres, yres, xres_out, yres_out);
-  inv_map(x + 0.5, y - 0.5, u1, v1, xres, yres, xres_out, yres_out);
-  inv_map(x - 0.5, y + 0.5, u2, v2, xres, yres, xres_out, yres_out);
-  inv_map(x + 0.5, y + 0.5, u3, v3, xres, yres, xres_out, yres_out);
-  
-  scale_factor_x = ((u1 - u0) + (u3 - u2)) / 2;
-  scale_factor_y = ((v2 - v0) + (v3 - v1)) / 2;
-}
+inline const unsigned char *texel(const unsigned char pixmap[], int row_in, int col_in)
+  {return pixmap + (row_in * xres + col_in) * 4;}
 
 
 /*
 magnification fix: 
 bilinear interpolation
   c_output = (1 - s) * (1 - t) * c0 + s * (1 - t) * c1 + (1 - s) * t * c2 + s * t * c3
+  pixmap is a pixmap or a texel cache
 */
-unsigned char bilinear_interpolation(double u, double v, int row_out, int col_out, int channel, unsigned char pixmap[])
+template <class Texels>
+unsigned char bilinear_interpolation(double u, double v, int row_out, int col_out, int channel, Texels &pixmap)
 {
   // calculate the positions of four points to do the bilinear interpolation
   double u0, v0, u1, v1, u2, v2, u3, v3, s, t;
@@ -156,20 +254,21 @@ unsigned char bilinear_interpolation(double u, double v, int row_out, int col_ou
     u0 = (u >= xres - 0.5) ? (xres - 0.5) : (0.5);
   }
 
-  u1 = u0 + 1;
+  // on the last row or column the neighbours beyond the image have weight 0, take the edge texels instead
+  u1 = min(u0 + 1, xres - 0.5);
   v1 = v0;
   u2 = u0;
-  v2 = v0 + 1;
-  u3 = u0 + 1;
-  v3 = v0 + 1;
+  v2 = min(v0 + 1, yres - 0.5);
+  u3 = u1;
+  v3 = v2;
 
   // get the color of four points
   double c0, c1, c2, c3;
   unsigned char c_out;
-  c0 = pixmap[(int(floor(v0)) * xres + int(floor(u0))) * 4 + channel];
-  c1 = pixmap[(int(floor(v1)) * xres + int(floor(u1))) * 4 + channel];
-  c2 = pixmap[(int(floor(v2)) * xres + int(floor(u2))) * 4 + channel];
-  c3 = pixmap[(int(floor(v3)) * xres + int(floor(u3))) * 4 + channel];
+  c0 = texel(pixmap, int(floor(v0)), int(floor(u0)))[channel];
+  c1 = texel(pixmap, int(floor(v1)), int(floor(u1)))[channel];
+  c2 = texel(pixmap, int(floor(v2)), int(floor(u2)))[channel];
+  c3 = texel(pixmap, int(floor(v3)), int(floor(u3)))[channel];
   c_out = (1 - s) * (1 - t) * c0 + s * (1 - t) * c1 + (1 - s) * t * c2 + s * t * c3;
   
   return c_out;
@@ -178,9 +277,9 @@ unsigned char bilinear_interpolation(double u, double v, int row_out, int col_ou
 
 /*
 minification fix: 
-supersampling
+supersampling of the input pixel (row_in, col_in) into c_out
 */
-void supersampling(int row_in, int col_in, unsigned char super_inputpixmap[])
+void supersampling(int row_in, int col_in, unsigned char c_out[4])
 {
   double weight_list[] = {1.0, 2.0, 1.0, 
                           2.0, 8.0, 2.0, 
@@ -204,7 +303,6 @@ void supersampling(int row_in, int col_in, unsigned char super_inputpixmap[])
   {
     double weight_count = 0;
     double sum = 0;
-    unsigned char c_out;
     for (int i = 0; i < 9; ++i)
     {
       if (index_list[i] != -1)
@@ -213,17 +311,16 @@ void supersampling(int row_in, int col_in, unsigned char super_inputpixmap[])
         weight_count += weight_list[i];
       }
     }
-    c_out = sum / weight_count;
-    super_inputpixmap[(row_in * xres + col_in) * 4 + channel] = c_out;
+    c_out[channel] = sum / weight_count;
   }
 }
 
 
 /*
 minification fix: 
-adaptive supersampling
+adaptive supersampling of the input pixel (row_in, col_in) into c_out
 */
-void ad_supersampling(int row_in, int col_in, unsigned char adsuper_inputpixmap[])
+void ad_supersampling(int row_in, int col_in, unsigned char c_out[4])
 {
   double weight_list[] = {1.0, 2.0, 1.0, 
                           2.0, 8.0, 2.0, 
@@ -272,7 +369,6 @@ void ad_supersampling(int row_in, int col_in, unsigned char adsuper_inputpixmap[
   {
     double weight_count = 0;
     double sum = 0;
-    unsigned char c_out;
     for (int i = 0; i < 9; ++i)
     {
       if (index_list[i] != -1)
@@ -281,54 +377,335 @@ void ad_supersampling(int row_in, int col_in, unsigned char adsuper_inputpixmap[
         weight_count += weight_list[i];
       }
     }
-    c_out = sum / weight_count;
-    adsuper_inputpixmap[(row_in * xres + col_in) * 4 + channel] = c_out;
+    c_out[channel] = sum / weight_count;
   }
 }
 
 
 /*
-warp image
+input image filtered by supersampling or adaptive supersampling, computed a tile at a time:
+  a TEXEL_TILE x TEXEL_TILE tile is filtered into its own heap buffer when the warp first reads one of its texels,
+  so only the tiles under the output pixels that use the filter are ever computed
 */
-void warpimage()
+class TexelCache
 {
-  xres_out = xres;
-  yres_out = yres;
-  cout << "Output image size: " << xres_out << "x" << yres_out << endl;
-  // allocate memory for output pixmap: output image is 4 channels
-  outputpixmap = new unsigned char [xres_out * yres_out * 4];
-  // fill the output image with a clear transparent color(0, 0, 0, 0)
-  for (int i = 0; i < xres_out * yres_out * 4; i++) {outputpixmap[i] = 0;}
+public:
+  TexelCache(void (*texel_filter)(int row_in, int col_in, unsigned char c_out[4]))
+  {
+    filter = texel_filter;
+    tiles_x = (xres + TEXEL_TILE - 1) / TEXEL_TILE;
+    tiles_y = (yres + TEXEL_TILE - 1) / TEXEL_TILE;
+    tiles.resize(tiles_x * tiles_y);
+    computed = 0;
+  }
+
+  // filtered texel (row_in, col_in)
+  const unsigned char *texel(int row_in, int col_in)
+  {
+    vector<unsigned char> &tile = tiles[(row_in / TEXEL_TILE) * tiles_x + col_in / TEXEL_TILE];
+    if (tile.empty())  {fill(tile, row_in - row_in % TEXEL_TILE, col_in - col_in % TEXEL_TILE);}
+    return &tile[((row_in % TEXEL_TILE) * TEXEL_TILE + col_in % TEXEL_TILE) * 4];
+  }
+
+  int tiles_computed() const {return computed;}
+  int tiles_total() const {return tiles_x * tiles_y;}
+
+private:
+  void (*filter)(int row_in, int col_in, unsigned char c_out[4]);
+  int tiles_x, tiles_y;
+  vector<vector<unsigned char> > tiles;  // RGBA texels of each tile row by row, empty until computed
+  int computed;
+
+  void fill(vector<unsigned char> &tile, int row0, int col0)
+  {
+    tile.resize(TEXEL_TILE * TEXEL_TILE * 4);
+    for (int row = row0; row < min(row0 + TEXEL_TILE, yres); row++)
+    {
+      for (int col = col0; col < min(col0 + TEXEL_TILE, xres); col++)
+        {filter(row, col, &tile[((row - row0) * TEXEL_TILE + col - col0) * 4]);}
+    }
+    computed++;
+  }
+};
+inline const unsigned char *texel(TexelCache &cache, int row_in, int col_in) {return cache.texel(row_in, col_in);}
+
+
+/*
+number of mipmap levels of the input image, down to a 1x1 level
+*/
+int mipmap_levels()
+{
+  int levels = 1;
+  for (int w = xres, h = yres; w > 1 || h > 1; w = (w + 1) / 2, h = (h + 1) / 2)  {levels++;}
+  return levels;
+}
 
-  // supersampling & adaptive supersampling
-  unsigned char super_inputpixmap[xres * yres * 4];
-  unsigned char adsuper_inputpixmap[xres * yres * 4];
-  for (int row_in = 0; row_in < yres; row_in++)
+
+/*
+mipmap level of the input image, the missing levels up to it are built from the level before each
+  texel (row, col) of level l is the average of the input pixels of the 2^l x 2^l block at (row * 2^l, col * 2^l),
+  blocks on the right and top edges are clipped to the image
+*/
+const MipLevel &mipmap_level(int level)
+{
+  if (mipmap.empty())
+  {
+    MipLevel base;
+    base.width = xres;
+    base.height = yres;
+    mipmap.push_back(base);
+  }
+  while (int(mipmap.size()) <= level)
   {
-    for (int col_in = 0; col_in < xres; col_in++)
+    MipLevel coarse;
+    {
+      const MipLevel &fine = mipmap.back();
+      const unsigned char *src = fine.texels();
+      coarse.width = (fine.width + 1) / 2;
+      coarse.height = (fine.height + 1) / 2;
+      coarse.pixels.resize(coarse.width * coarse.height * 4);
+      for (int row = 0; row < coarse.height; row++)
       {
-        // supersampling
-        supersampling(row_in, col_in, super_inputpixmap);
-        // adaptive supersampling
-        ad_supersampling(row_in, col_in, adsuper_inputpixmap);
+        for (int col = 0; col < coarse.width; col++)
+        {
+          // the 2x2 texels of the finer level, clipped to it
+          int rows = min(2, fine.height - 2 * row);
+          int cols = min(2, fine.width - 2 * col);
+          for (int k = 0; k < 4; k++)
+          {
+            int sum = 0;
+            for (int i = 0; i < rows; i++)
+            {
+              for (int j = 0; j < cols; j++)  {sum += src[((2 * row + i) * fine.width + 2 * col + j) * 4 + k];}
+            }
+            coarse.pixels[(row * coarse.width + col) * 4 + k] = (sum + rows * cols / 2) / (rows * cols);
+          }
+        }
       }
+    }
+    mipmap.push_back(coarse);
   }
+  return mipmap[level];
+}
+
+
+/*
+add weight times the bilinear interpolated color at input image position (u, v) of a mipmap level to color
+  positions outside the level take the nearest edge texels
+*/
+void mipmap_bilinear(int level, double u, double v, double weight, double color[4])
+{
+  const MipLevel &l = mipmap_level(level);
+  const unsigned char *texels = l.texels();
+  // texel centers of the level are at (col + 0.5) * 2^level
+  double s = ldexp(u, -level) - 0.5;
+  double t = ldexp(v, -level) - 0.5;
+  int col0 = floor(s);
+  int row0 = floor(t);
+  s -= col0;
+  t -= row0;
+  int col1 = min(max(col0 + 1, 0), l.width - 1);
+  int row1 = min(max(row0 + 1, 0), l.height - 1);
+  col0 = min(max(col0, 0), l.width - 1);
+  row0 = min(max(row0, 0), l.height - 1);
+
+  const unsigned char *c0 = texels + (row0 * l.width + col0) * 4;
+  const unsigned char *c1 = texels + (row0 * l.width + col1) * 4;
+  const unsigned char *c2 = texels + (row1 * l.width + col0) * 4;
+  const unsigned char *c3 = texels + (row1 * l.width + col1) * 4;
+  for (int k = 0; k < 4; k++)
+    {color[k] += weight * ((1 - s) * (1 - t) * c0[k] + s * (1 - t) * c1[k] + (1 - s) * t * c2[k] + s * t * c3[k]);}
+}
+
+
+/*
+minification and magnification fix:
+mipmap filtering
+  the footprint of the output pixel in the input image is scale_factor_x x scale_factor_y input pixels;
+  it is covered by up to MAX_ANISOTROPY probes along its long side, each a trilinear lookup of the mipmap level
+  whose texels match the probe's share of the footprint, so the filter cost only grows with the minification;
+  a footprint that is square up to rounding, such as the differenced scale factors of an identity warp, is one probe
+*/
+void mipmap_filter(double u, double v, double scale_factor_x, double scale_factor_y, unsigned char c_out[4])
+{
+  // magnified sides of the footprint are interpolated at level 0
+  double fx = max(fabs(scale_factor_x), 1.0);
+  double fy = max(fabs(scale_factor_y), 1.0);
+  double major = max(fx, fy);
+  double minor = min(fx, fy);
+  int probes = min(int(ceil(major / minor - 1e-6)), MAX_ANISOTROPY);
+
+  // level of detail between the two nearest levels
+  double lod = min(log2(max(minor, major / probes)), double(mipmap_levels() - 1));
+  int level = floor(lod);
+  double frac = lod - level;
+
+  double color[4] = {0, 0, 0, 0};
+  for (int i = 0; i < probes; i++)
+  {
+    // probe centers evenly spaced along the long side of the footprint, the outer probes touch its ends
+    double offset = (probes > 1) ? (double(i) / (probes - 1) - 0.5) * (major - minor) : 0;
+    double pu = (fx >= fy) ? (u + offset) : u;
+    double pv = (fx >= fy) ? v : (v + offset);
+    mipmap_bilinear(level, pu, pv, (1 - frac) / probes, color);
+    if (frac > 0) {mipmap_bilinear(level + 1, pu, pv, frac / probes, color);}
+  }
+  for (int k = 0; k < 4; k++) {c_out[k] = min(color[k] + 0.5, 255.0);}
+}
+
+
+/*
+inverse map of the output pixels with a warp function
+  Separable: u and its scale factor are inverse mapped once per output column,
+  v and its scale factor once per output row, every pixel then reads the tables
+*/
+template <class Warp, bool Separable>
+class PixelMap
+{
+public:
+  PixelMap(const Warp &w) : warp(w)
+  {
+    float u, v;
+    double scale_factor_x, scale_factor_y;
+    u_col.resize(xres_out);
+    scale_col.resize(xres_out);
+    v_row.resize(yres_out);
+    scale_row.resize(yres_out);
+    for (int col_out = 0; col_out < xres_out; col_out++)
+      {inv_map(warp, float(col_out) + 0.5, 0.5, u_col[col_out], v, xres, yres, xres_out, yres_out, scale_col[col_out], scale_factor_y);}
+    for (int row_out = 0; row_out < yres_out; row_out++)
+      {inv_map(warp, 0.5, float(row_out) + 0.5, u, v_row[row_out], xres, yres, xres_out, yres_out, scale_factor_x, scale_row[row_out]);}
+  }
+
+  // select the output row, before its pixels are read
+  void row(int row_out)
+  {
+    v_selected = v_row[row_out];
+    scale_selected = scale_row[row_out];
+  }
+
+  void inverse(int col_out, float &u, float &v, double &scale_factor_x, double &scale_factor_y) const
+  {
+    u = u_col[col_out];
+    v = v_selected;
+    scale_factor_x = scale_col[col_out];
+    scale_factor_y = scale_selected;
+  }
+
+private:
+  const Warp &warp;
+  vector<float> u_col, v_row;  // u of every output column and v of every output row
+  vector<double> scale_col, scale_row;  // and their scale factors
+  float v_selected;  // v and scale factor of the selected row
+  double scale_selected;
+};
+
+
+/*
+inverse map of the output pixels with a warp function that is not separable
+  the output rows are inverse mapped one at a time, every pixel once, and the scale factors are
+  the differences of u and v to the neighbouring pixels of the row and of the column
+  (one-sided on the image border), so no pixel pays extra maps for its derivatives
+*/
+template <class Warp>
+class PixelMap<Warp, false>
+{
+public:
+  PixelMap(const Warp &w) : warp(w)
+  {
+    for (int i = 0; i < 3; i++)
+    {
+      u_rows[i].resize(xres_out);
+      v_rows[i].resize(xres_out);
+      mapped[i] = -1;
+    }
+    u_px.resize(xres_out);
+    v_px.resize(xres_out);
+    scale_x.resize(xres_out);
+    scale_y.resize(xres_out);
+  }
+
+  // inverse map the output row, before its pixels are read
+  void row(int row_out)
+  {
+    int top = max(row_out - 1, 0);
+    int bottom = min(row_out + 1, yres_out - 1);
+    int center = map_row(row_out);
+    const vector<double> &u = u_rows[center];
+    const vector<double> &v = v_rows[center];
+    const vector<double> &v_top = v_rows[map_row(top)];
+    const vector<double> &v_bottom = v_rows[map_row(bottom)];
+    for (int col_out = 0; col_out < xres_out; col_out++)
+    {
+      int left = max(col_out - 1, 0);
+      int right = min(col_out + 1, xres_out - 1);
+      // input pixels per output pixel
+      scale_x[col_out] = (right > left) ? (u[right] - u[left]) / (right - left) * xres : 0;
+      scale_y[col_out] = (bottom > top) ? (v_bottom[col_out] - v_top[col_out]) / (bottom - top) * yres : 0;
+      // scale normalized (u, v) to pixel coords, as inv_map
+      u_px[col_out] = float(u[col_out]) * xres;
+      v_px[col_out] = float(v[col_out]) * yres;
+      u_px[col_out] = (u_px[col_out] == xres) ? (u_px[col_out] - 0.0001) : u_px[col_out];
+      v_px[col_out] = (v_px[col_out] == yres) ? (v_px[col_out] - 0.0001) : v_px[col_out];
+    }
+  }
+
+  void inverse(int col_out, float &u, float &v, double &scale_factor_x, double &scale_factor_y) const
+  {
+    u = u_px[col_out];
+    v = v_px[col_out];
+    scale_factor_x = scale_x[col_out];
+    scale_factor_y = scale_y[col_out];
+  }
+
+private:
+  const Warp &warp;
+  vector<double> u_rows[3], v_rows[3];  // normalized (u, v) of the last three mapped rows, row r in slot r % 3
+  int mapped[3];  // row held by each slot
+  vector<float> u_px, v_px;  // the current row in input pixel coords
+  vector<double> scale_x, scale_y;  // and its scale factors
+
+  int map_row(int row_out)
+  {
+    int slot = row_out % 3;
+    if (mapped[slot] == row_out)  {return slot;}
+    float y = (float(row_out) + 0.5) / yres_out;  // normalize as inv_map
+    for (int col_out = 0; col_out < xres_out; col_out++)
+    {
+      float x = (float(col_out) + 0.5) / xres_out;
+      warp.map(x, y, u_rows[slot][col_out], v_rows[slot][col_out]);
+    }
+    mapped[slot] = row_out;
+    return slot;
+  }
+};
+
+
+/*
+warp the input image into the output image with a warp function
+  the pixel loop is instantiated for each warp function and for its table or direct inverse map,
+  so the function is inlined into it and there is no branch on the kind of map inside
+*/
+template <class Warp, bool Separable>
+void warp_pixels(const Warp &warp)
+{
+  // supersampling & adaptive supersampling, computed for the tiles the minified output pixels read
+  TexelCache super_inputpixmap(supersampling);
+  TexelCache adsuper_inputpixmap(ad_supersampling);
 
   // inverse map
-  float x, y, u, v;
+  PixelMap<Warp, Separable> pixels(warp);
+  float u, v;
   for (int row_out = 0; row_out < yres_out; row_out++)  // output row
   {
+    pixels.row(row_out);
     for (int col_out = 0; col_out < xres_out; col_out++)  // output col
     {
       double scale_factor_x = 1.0;
       double scale_factor_y = 1.0;
 
-      x = float(col_out) + 0.5;
-      y = float(row_out) + 0.5;      
-      // inverse mapping functions
-      inv_map(x, y, u, v, xres, yres, xres_out, yres_out);
-      // calculate scale factor
-      scale_factor(x, y, scale_factor_x, scale_factor_y);
+      // inverse mapping functions and scale factor
+      pixels.inverse(col_out, u, v, scale_factor_x, scale_factor_y);
 
       if (u < xres && v < yres && u >= 0 && v >= 0)
       {
@@ -336,6 +713,13 @@ void warpimage()
         row_in = floor(v);
         col_in = floor(u);
 
+        // mipmap filtering for minification and magnification
+        if (mode == 5)
+        {
+          mipmap_filter(u, v, scale_factor_x, scale_factor_y, &outputpixmap[(row_out * xres_out + col_out) * 4]);
+          continue;
+        }
+
         for (int k = 0; k < 4; k++)
         {
           switch (mode)
@@ -348,14 +732,14 @@ void warpimage()
             // supersampling for minification
             case 2:
               if (scale_factor_x > 1 || scale_factor_y > 1)
-                {outputpixmap[(row_out * xres_out + col_out) * 4 + k] = super_inputpixmap[(row_in * xres + col_in) * 4 + k];}
+                {outputpixmap[(row_out * xres_out + col_out) * 4 + k] = super_inputpixmap.texel(row_in, col_in)[k];}
               else {outputpixmap[(row_out * xres_out + col_out) * 4 + k] = inputpixmap[(row_in * xres + col_in) * 4 + k];}
               break;
 
             // adaptive supersampling for minification
             case 3:
               if (scale_factor_x > 1 || scale_factor_y > 1)
-                {outputpixmap[(row_out * xres_out + col_out) * 4 + k] = adsuper_inputpixmap[(row_in * xres + col_in) * 4 + k];}
+                {outputpixmap[(row_out * xres_out + col_out) * 4 + k] = adsuper_inputpixmap.texel(row_in, col_in)[k];}
               else {outputpixmap[(row_out * xres_out + col_out) * 4 + k] = inputpixmap[(row_in * xres + col_in) * 4 + k];}
               break;
 
@@ -384,17 +768,105 @@ void warpimage()
                 {outputpixmap[(row_out * xres_out + col_out) * 4 + k] = inputpixmap[(row_in * xres + col_in) * 4 + k];}
               // minification
               else
-                {outputpixmap[(row_out * xres_out + col_out) * 4 + k] = adsuper_inputpixmap[(row_in * xres + col_in) * 4 + k];}
+                {outputpixmap[(row_out * xres_out + col_out) * 4 + k] = adsuper_inputpixmap.texel(row_in, col_in)[k];}
               break;
 
             default:
-              cout << "please select mode between 0-4." << endl;
+              cout << "please select mode between 0-5." << endl;
               exit(0);
           }
         }
       }
     }
   }
+  if (mode == 2)
+    {cout << "Supersampled tiles: " << super_inputpixmap.tiles_computed() << " of " << super_inputpixmap.tiles_total() << endl;}
+  if (mode == 3 || mode == 0)
+    {cout << "Adaptive supersampled tiles: " << adsuper_inputpixmap.tiles_computed() << " of " << adsuper_inputpixmap.tiles_total() << endl;}
+}
+
+
+/*
+warp the input image with the pixel loop of the separable or the general inverse map,
+  chosen once for the whole image
+*/
+template <class Warp>
+void warp_image(const Warp &warp)
+{
+  if (warp.separable())  {warp_pixels<Warp, true>(warp);}
+  else  {warp_pixels<Warp, false>(warp);}
+}
+
+
+// a warp function and the pixel loop instantiated for it
+struct WarpFunction
+{
+  string name;
+  function<void()> warp;
+};
+static vector<WarpFunction> warp_functions;  // registered warp functions, -w selects warp_functions[warp_id]
+
+
+/*
+add a warp function, warp is copied and set up for the warp
+*/
+template <class Warp>
+void register_warp(const string &name, const Warp &warp)
+{
+  WarpFunction entry;
+  entry.name = name;
+  entry.warp = [warp]()
+  {
+    Warp w = warp;
+    w.setup();
+    warp_image(w);
+  };
+  warp_functions.push_back(entry);
+}
+
+
+/*
+register the warp functions 0 and 1
+*/
+void register_warps()
+{
+  register_warp("dr. house's okwarp function", HouseWarp());
+  register_warp("my warp function", PowerSineWarp());
+}
+
+
+/*
+register user formulas as the next warp function, return its number
+*/
+int register_expression_warp(const string &u_text, const string &v_text)
+{
+  ExpressionWarp warp;
+  vector<string> variables = {"x", "y", "r", "a"};
+  string error;
+  if (!warp.u_formula.compile(u_text, variables, error) or !warp.v_formula.compile(v_text, variables, error))
+  {
+    cerr << "Bad warp formula: " << error << endl;
+    exit(0);
+  }
+  register_warp("u = " + u_text + ", v = " + v_text, warp);
+  return warp_functions.size() - 1;
+}
+
+
+/*
+warp image
+*/
+void warpimage()
+{
+  xres_out = xres;
+  yres_out = yres;
+  cout << "Output image size: " << xres_out << "x" << yres_out << endl;
+  // allocate memory for output pixmap: output image is 4 channels
+  outputpixmap = new unsigned char [xres_out * yres_out * 4];
+  // fill the output image with a clear transparent color(0, 0, 0, 0)
+  for (int i = 0; i < xres_out * yres_out * 4; i++) {outputpixmap[i] = 0;}
+
+  warp_functions[warp_id].warp();
 }
 
 
@@ -421,8 +893,8 @@ void readimage(string infilename)
     cout << "Input image size: " << xres << "x" << yres << endl;
     cout << "channels: " << channels << endl;
 
-    unsigned char tmppixmap[xres * yres * channels];
-    in -> read_image(TypeDesc::UINT8, tmppixmap);
+    vector<unsigned char> tmppixmap(xres * yres * channels);
+    in -> read_image(TypeDesc::UINT8, &tmppixmap[0]);
 
     // convert input image to RGBA image
     inputpixmap = new unsigned char [xres * yres * 4];  // input image pixel map is 4 channels
@@ -453,7 +925,7 @@ void readimage(string infilename)
       }
     }
 
-    unsigned char displaypixmap[xres * yres * 4];
+    vector<unsigned char> displaypixmap(xres * yres * 4);
     // modify the pixmap: upside down the image
     for (int row = 0; row < yres; row++)
     {
@@ -485,7 +957,7 @@ void writeimage(string outfilename)
   else
   {
     // modify the pixmap: upside down the image
-    unsigned char outmap [xres_out * yres_out * 4];
+    vector<unsigned char> outmap(xres_out * yres_out * 4);
     for (int row = 0; row < yres_out; row++)
     {
       for (int col = 0; col < xres_out; col++)
@@ -499,12 +971,12 @@ void writeimage(string outfilename)
     ImageSpec spec (xres_out, yres_out, 4, TypeDesc::UINT8);
     out -> open(outfilename, spec);
     // write the entire image
-    out -> write_image(TypeDesc::UINT8, outmap);
+    out -> write_image(TypeDesc::UINT8, &outmap[0]);
 
     // .ppm file: 3 channels
     if (outfilename.substr(outfilename.find_last_of(".") + 1, outfilename.length() - 1) == "ppm")
     {
-      unsigned char pixmap[xres_out * yres_out * 3];
+      vector<unsigned char> pixmap(xres_out * yres_out * 3);
       for (int row = 0; row < yres_out; row++)
       {
         for (int col = 0; col < xres_out; col++)
@@ -515,7 +987,7 @@ void writeimage(string outfilename)
       }
       ImageSpec spec (xres_out, yres_out, 3, TypeDesc::UINT8);
       out -> open(outfilename, spec);
-      out -> write_image(TypeDesc::UINT8, pixmap);
+      out -> write_image(TypeDesc::UINT8, &pixmap[0]);
     }
 
     cout << "Write the warped image to image file " << outfilename << endl;
@@ -585,8 +1057,9 @@ void handleReshape_out(int w, int h)  {handleReshape(w, h, xres_out, yres_out);}
 /*
 command line options parser
   warp input_image_name [output_image_name]
-    -m mode selection: 0-4
+    -m mode selection: 0-5
     -w warp function selection: 0-1
+    -u formula -v formula: user warp function
 */
 char **getIter(char** begin, char** end, const std::string& option) {return find(begin, end, option);}
 void getCmdOptions(int argc, char* argv[], string &inputImage, string &outputImage, int &mode)
@@ -596,6 +1069,7 @@ void getCmdOptions(int argc, char* argv[], string &inputImage, string &outputIma
   mode_list[2] = "warp with clean method supersampling for minification";
   mode_list[3] = "warp with clean method adaptive supersampling for minification";
   mode_list[4] = "warp with clean method bilinear interpolation for magnification";
+  mode_list[5] = "warp with clean method mipmap filtering for minification and magnification";
   mode_list[0] = "all clean warp (adaptive supersampling + bilinear interpolation)";
   if (argc >= 2)
   {
@@ -609,20 +1083,34 @@ void getCmdOptions(int argc, char* argv[], string &inputImage, string &outputIma
       // get output image name
       string tmp;
       tmp = argv[2];
-      if (tmp != "-m" && tmp != "-w")  {outputImage = argv[2];}
+      if (tmp != "-m" && tmp != "-w" && tmp != "-u" && tmp != "-v")  {outputImage = argv[2];}
       // mode selection
       char **iter = getIter(argv, argv + argc, "-m");
       if (iter != argv + argc)  {if (++iter != argv + argc)  {mode = atoi(iter[0]);}}
-      if (mode > 4 || mode < 0)
+      if (mode > 5 || mode < 0)
       {
-        cout << "please select mode between 0-4." << endl;
+        cout << "please select mode between 0-5." << endl;
         exit(0);
       }
       cout << "warp mode " << mode << ": " << mode_list[mode] << endl;
       // warp function selection
       iter = getIter(argv, argv + argc, "-w");
       if (iter != argv + argc)  {if (++iter != argv + argc)  {warp_id = atoi(iter[0]);}}
-      cout << "warp function: " << warp_id << endl;
+      // user warp function: formulas of u and v, x or y if one is not given
+      char **u_iter = getIter(argv, argv + argc, "-u");
+      char **v_iter = getIter(argv, argv + argc, "-v");
+      if ((u_iter != argv + argc && u_iter + 1 != argv + argc) || (v_iter != argv + argc && v_iter + 1 != argv + argc))
+      {
+        string u_text = (u_iter != argv + argc && u_iter + 1 != argv + argc) ? u_iter[1] : "x";
+        string v_text = (v_iter != argv + argc && v_iter + 1 != argv + argc) ? v_iter[1] : "y";
+        warp_id = register_expression_warp(u_text, v_text);
+      }
+      if (warp_id < 0 || warp_id >= int(warp_functions.size()))
+      {
+        cout << "please select warp function between 0-1." << endl;
+        exit(0);
+      }
+      cout << "warp function " << warp_id << ": " << warp_functions[warp_id].name << endl;
     }
   }
   else
@@ -634,6 +1122,7 @@ void getCmdOptions(int argc, char* argv[], string &inputImage, string &outputIma
          << "    2: " << mode_list[2] << "\n"
          << "    3: " << mode_list[3] << "\n"
          << "    4: " << mode_list[4] << "\n"
+         << "    5: " << mode_list[5] << "\n"
          << "    0: " << mode_list[0] << "\n"
          << "    default mode: mode 0" << endl;
     cout << "  -w warp function selection" << endl;
@@ -641,6 +1130,11 @@ void getCmdOptions(int argc, char* argv[], string &inputImage, string &outputIma
          << "    1: my warp function\n"
          << "    default warp function: 0"
          << endl;
+    cout << "  -u formula -v formula user warp function" << endl;
+    cout << "    u and v of the input image as formulas of the output image coordinates x, y\n"
+         << "    and their polar coordinates r, a around the image center, all coordinates 0-1\n"
+         << "    for example: -u \"sqrt(x)\" -v \"0.5 * (1 + sin(y * pi))\" maps like warp function 0"
+         << endl;
     exit(0);
   }
 }
@@ -655,6 +1149,7 @@ int main(int argc, char* argv[])
   string outputImage; // output image file name
 
   // command line parser
+  register_warps();
   getCmdOptions(argc, argv, inputImage, outputImage, mode);
 
   // read input image
@@ -0,0 +1,1299 @@
+/*
+Convolution engine of filt: kernels, input planes and the direct, separable, interleaved,
+reduced precision and FFT convolution paths.
+The filt and filt_batch programs and the filtbench benchmark share it.
+
+Jingcong Zhang
+jingcoz@g.clemson.edu
+*/
+
+# include <stdlib.h>
+# include <cstdlib>
+# include <iostream>
+# include <fstream>
+# include <string>
+# include <algorithm>
+# include <math.h>
+# include <cmath>
+# include <iomanip>
+# include <vector>
+# include <functional>
+
+# include "convolve.h"
+# include "fft.h"
+# include "simd.h"
+# include "plane.h"
+# include "kernelcache.h"
+
+using namespace std;
+
+
+unsigned char *inputpixmap;   // input image pixel map
+unsigned char *outputpixmap;   // output image pixel map
+double **kernel;   // 2D-array to store convolutional kernel
+int inputChannels;   // color channel number of input image
+int xres, yres;   // window size: image width, image height
+int kernel_size;   // kernel size
+int kernel_rank;   // number of separable terms of the kernel, 0 if the kernel is run as a full 2D kernel
+double **kernel_col;   // separable factors: kernel[i][j] ~ sum of kernel_col[k][i] * kernel_row[k][j]
+double **kernel_row;
+ConvMethod conv_method = CONV_AUTO;  // convolution method, auto picks the cheaper one for the kernel and image size
+Precision precision = PRECISION_DOUBLE;  // arithmetic of the direct path, double is the reference
+bool use_separable = true;  // factor kernels into separable passes when that saves taps
+bool use_fixed_kernels = true;  // run 3x3, 5x5 and 7x7 kernels on the unrolled 2D routines
+static float *kernel_float;   // flipped kernel and separable factors for the float path
+static float *kernel_row_float;
+static float *kernel_col_float;
+static int16_t *kernel_int16;   // flipped fixed-point kernel for the int16 path
+static int kernel_shift;  // fixed-point scale of kernel_int16 is 2^kernel_shift
+
+// output region [row0, row1) x [col0, col1) processed as one task
+struct Tile
+{
+  int row0, row1;
+  int col0, col1;
+};
+const int TILE_SIZE = 128;  // tile width and height in pixels, a tile and its halo stay in the L2 cache
+
+int plane_border;   // reflected border of the input planes: the largest kernel radius
+static Plane<double> *channel_planes;   // input channel planes on scale 0-1 with a reflected border, shared by every kernel
+static Plane<double> *interleaved_plane;   // the same input with all channels interleaved
+static vector<Complex *> input_spectra;   // FFT of the input channel pairs, computed the first time the FFT path runs
+static Plane<double> *channel_sats;   // summed-area tables of the channel planes, computed the first time the box path runs
+
+vector<int> box_radii;
+double box_gain = 1;  // scale of the last box pass: the kernel value times its area for a constant kernel
+
+
+/*
+name of the direct path arithmetic
+*/
+string precisionName()
+{
+  if (precision == PRECISION_FLOAT) {return string("float ") + simdName();}
+  if (precision == PRECISION_INT16) {return string("int16 ") + simdName();}
+  return "double";
+}
+
+
+/*
+store a channel value on scale 0-1 in the sample type of a tile buffer
+  fixed-point samples keep the original 0-255 value
+*/
+inline void storeSample(double value, float &sample)  {sample = value;}
+inline void storeSample(double value, int16_t &sample)  {sample = lrint(value * 255);}
+
+
+/*
+copy a tile of the input plane and its halo into a contiguous buffer of the reduced precision sample type
+  the halo is n pixels wide on each side and comes from the reflected border apron of the plane
+*/
+template <class T>
+void loadTile(const Plane<double> &in, const Tile &tile, int n, T *buf)
+{
+  int stride = (tile.col1 - tile.col0) + 2 * n;
+  for (int y = 0; y < (tile.row1 - tile.row0) + 2 * n; y++)
+  {
+    const double *src = in.row(tile.row0 - n + y) + tile.col0 - n;
+    T *dst = buf + y * stride;
+    for (int x = 0; x < stride; x++)  {storeSample(src[x], dst[x]);}
+  }
+}
+
+
+/*
+convolutional operation on one tile of the output
+  the input plane border holds at least the kernel radius, so the borders take the same path as the interior
+*/
+void conv(const Plane<double> &in, Plane<double> &out, const Tile &tile)
+{
+  int n = (kernel_size - 1) / 2;
+  for (int row = tile.row0; row < tile.row1; row++)
+  {
+    double *dst = out.row(row);
+    for (int col = tile.col0; col < tile.col1; col++)
+    {
+      double sum = 0;
+      for (int i = 0; i < kernel_size; i++)
+      {
+        const double *src = in.row(row - n + i) + col - n;
+        for (int j = 0; j < kernel_size; j++)
+        {
+          sum += kernel[kernel_size - 1 - i][kernel_size - 1 - j] * src[j];
+        }
+      }
+      dst[col] = sum;
+    }
+  }
+}
+
+
+/*
+separable convolutional operation on one tile of the output
+  run each separable term of the kernel as a horizontal 1D pass followed by a vertical 1D pass
+*/
+void convSeparable(const Plane<double> &in, Plane<double> &out, const Tile &tile)
+{
+  int n = (kernel_size - 1) / 2;
+  int tw = tile.col1 - tile.col0;
+  int th = tile.row1 - tile.row0;
+  double *tmp = new double [(th + 2 * n) * tw];
+
+  for (int y = 0; y < th; y++)
+  {
+    double *dst = out.row(tile.row0 + y) + tile.col0;
+    for (int x = 0; x < tw; x++)  {dst[x] = 0;}
+  }
+
+  for (int k = 0; k < kernel_rank; k++)
+  {
+    // horizontal pass over the tile rows and the halo rows
+    for (int y = 0; y < th + 2 * n; y++)
+    {
+      const double *src = in.row(tile.row0 - n + y) + tile.col0 - n;
+      for (int x = 0; x < tw; x++)
+      {
+        double sum = 0;
+        for (int j = 0; j < kernel_size; j++)  {sum += kernel_row[k][kernel_size - 1 - j] * src[x + j];}
+        tmp[y * tw + x] = sum;
+      }
+    }
+    // vertical pass, accumulated into the output
+    for (int y = 0; y < th; y++)
+    {
+      double *dst = out.row(tile.row0 + y) + tile.col0;
+      for (int x = 0; x < tw; x++)
+      {
+        double sum = 0;
+        for (int i = 0; i < kernel_size; i++)  {sum += kernel_col[k][kernel_size - 1 - i] * tmp[(y + i) * tw + x];}
+        dst[x] += sum;
+      }
+    }
+  }
+
+  delete [] tmp;
+}
+
+
+/*
+per-channel sums of one interleaved pixel, held in registers
+  CH is a compile-time constant, the unused channels fold away
+*/
+template <int CH>
+struct PixelSum
+{
+  double s0, s1, s2, s3;
+
+  PixelSum() : s0(0), s1(0), s2(0), s3(0) {}
+  void add(double weight, const double *p)
+  {
+    s0 += weight * p[0];
+    if (CH > 1) {s1 += weight * p[1];}
+    if (CH > 2) {s2 += weight * p[2];}
+    if (CH > 3) {s3 += weight * p[3];}
+  }
+  void store(double *p) const
+  {
+    p[0] = s0;
+    if (CH > 1) {p[1] = s1;}
+    if (CH > 2) {p[2] = s2;}
+    if (CH > 3) {p[3] = s3;}
+  }
+  void accumulate(double *p) const
+  {
+    p[0] += s0;
+    if (CH > 1) {p[1] += s1;}
+    if (CH > 2) {p[2] += s2;}
+    if (CH > 3) {p[3] += s3;}
+  }
+};
+
+
+/*
+convolutional operation on one tile of an interleaved plane of CH channels, 2 <= CH <= 4
+  all channels are filtered in one sweep, every kernel tap is loaded once per pixel
+*/
+template <int CH>
+void convInterleaved(const Plane<double> &in, Plane<double> &out, const Tile &tile)
+{
+  int n = (kernel_size - 1) / 2;
+  for (int row = tile.row0; row < tile.row1; row++)
+  {
+    double *dst = out.row(row);
+    for (int col = tile.col0; col < tile.col1; col++)
+    {
+      PixelSum<CH> sum;
+      for (int i = 0; i < kernel_size; i++)
+      {
+        const double *src = in.row(row - n + i) + (col - n) * CH;
+        const double *weights = kernel[kernel_size - 1 - i];
+        for (int j = 0; j < kernel_size; j++)  {sum.add(weights[kernel_size - 1 - j], src + j * CH);}
+      }
+      sum.store(dst + col * CH);
+    }
+  }
+}
+
+
+/*
+taps j = 0 ... J - 1 of one kernel row on CH interleaved channels, unrolled at compile time
+  weights holds the flipped kernel row, src the first input pixel under it
+*/
+template <int J, int CH>
+struct RowTaps
+{
+  static inline void add(PixelSum<CH> &sum, const double *weights, const double *src)
+  {
+    RowTaps<J - 1, CH>::add(sum, weights, src);
+    sum.add(weights[J - 1], src + (J - 1) * CH);
+  }
+};
+
+template <int CH>
+struct RowTaps<0, CH>
+{
+  static inline void add(PixelSum<CH> &, const double *, const double *) {}
+};
+
+
+/*
+convolutional operation on one tile for a K x K kernel fixed at compile time, CH = 1 for a channel plane
+  the taps are unrolled and the flipped kernel sits in a flat local array, the sums are taken
+  in the same order as conv() and convInterleaved(), so the result is the same to the last bit
+*/
+template <int K, int CH>
+void convFixed(const Plane<double> &in, Plane<double> &out, const Tile &tile)
+{
+  const int n = (K - 1) / 2;
+  double weights[K * K];
+  for (int i = 0; i < K; i++)
+  {
+    for (int j = 0; j < K; j++)  {weights[i * K + j] = kernel[K - 1 - i][K - 1 - j];}
+  }
+  for (int row = tile.row0; row < tile.row1; row++)
+  {
+    double *dst = out.row(row);
+    for (int col = tile.col0; col < tile.col1; col++)
+    {
+      PixelSum<CH> sum;
+      for (int i = 0; i < K; i++)  {RowTaps<K, CH>::add(sum, weights + i * K, in.row(row - n + i) + (col - n) * CH);}
+      sum.store(dst + col * CH);
+    }
+  }
+}
+
+
+/*
+run the specialized routine of the common kernel sizes 3, 5 and 7, false for any other size
+  at these sizes the unrolled 2D kernel is faster than separable passes, so it is used for separable kernels too
+*/
+template <int CH>
+bool convFixedSize(const Plane<double> &in, Plane<double> &out, const Tile &tile)
+{
+  if (!use_fixed_kernels)  {return false;}
+  switch (kernel_size)
+  {
+    case 3:
+      convFixed<3, CH>(in, out, tile);
+      return true;
+    case 5:
+      convFixed<5, CH>(in, out, tile);
+      return true;
+    case 7:
+      convFixed<7, CH>(in, out, tile);
+      return true;
+  }
+  return false;
+}
+
+
+/*
+separable convolutional operation on one tile of an interleaved plane of CH channels
+*/
+template <int CH>
+void convSeparableInterleaved(const Plane<double> &in, Plane<double> &out, const Tile &tile)
+{
+  int n = (kernel_size - 1) / 2;
+  int tw = tile.col1 - tile.col0;
+  int th = tile.row1 - tile.row0;
+  double *tmp = new double [(th + 2 * n) * tw * CH];
+
+  for (int y = 0; y < th; y++)
+  {
+    double *dst = out.row(tile.row0 + y) + tile.col0 * CH;
+    for (int x = 0; x < tw * CH; x++)  {dst[x] = 0;}
+  }
+
+  for (int k = 0; k < kernel_rank; k++)
+  {
+    // horizontal pass over the tile rows and the halo rows
+    for (int y = 0; y < th + 2 * n; y++)
+    {
+      const double *src = in.row(tile.row0 - n + y) + (tile.col0 - n) * CH;
+      for (int x = 0; x < tw; x++)
+      {
+        PixelSum<CH> sum;
+        for (int j = 0; j < kernel_size; j++)  {sum.add(kernel_row[k][kernel_size - 1 - j], src + (x + j) * CH);}
+        sum.store(tmp + (y * tw + x) * CH);
+      }
+    }
+    // vertical pass, accumulated into the output
+    for (int y = 0; y < th; y++)
+    {
+      double *dst = out.row(tile.row0 + y) + tile.col0 * CH;
+      for (int x = 0; x < tw; x++)
+      {
+        PixelSum<CH> sum;
+        for (int i = 0; i < kernel_size; i++)  {sum.add(kernel_col[k][kernel_size - 1 - i], tmp + ((y + i) * tw + x) * CH);}
+        sum.accumulate(dst + x * CH);
+      }
+    }
+  }
+
+  delete [] tmp;
+}
+
+
+/*
+interleaved convolution of one tile for the channel count of the image
+*/
+void convInterleavedTile(const Plane<double> &in, Plane<double> &out, const Tile &tile)
+{
+  bool separable = (kernel_rank > 0);
+  switch (in.channels())
+  {
+    case 2:
+      if (convFixedSize<2>(in, out, tile)) {break;}
+      if (separable)  {convSeparableInterleaved<2>(in, out, tile);}  else {convInterleaved<2>(in, out, tile);}
+      break;
+    case 3:
+      if (convFixedSize<3>(in, out, tile)) {break;}
+      if (separable)  {convSeparableInterleaved<3>(in, out, tile);}  else {convInterleaved<3>(in, out, tile);}
+      break;
+    case 4:
+      if (convFixedSize<4>(in, out, tile)) {break;}
+      if (separable)  {convSeparableInterleaved<4>(in, out, tile);}  else {convInterleaved<4>(in, out, tile);}
+      break;
+  }
+}
+
+
+/*
+single precision convolutional operation on one tile of the output
+  the vectorized kernels run on the tile buffer, which already holds the reflected halo
+*/
+void convFloat(const Plane<double> &in, Plane<double> &out, const Tile &tile)
+{
+  int n = (kernel_size - 1) / 2;
+  int tw = tile.col1 - tile.col0;
+  int th = tile.row1 - tile.row0;
+  int stride = tw + 2 * n;
+  float *buf = new float [(th + 2 * n) * stride];
+  float *result = new float [th * tw];
+  loadTile(in, tile, n, buf);
+
+  if (kernel_rank > 0)
+  {
+    float *tmp = new float [(th + 2 * n) * tw];
+    for (int k = 0; k < kernel_rank; k++)
+    {
+      convRectFloat(buf, stride, kernel_row_float + k * kernel_size, 1, kernel_size, tmp, tw, tw, th + 2 * n, false);
+      convRectFloat(tmp, tw, kernel_col_float + k * kernel_size, kernel_size, 1, result, tw, tw, th, k > 0);
+    }
+    delete [] tmp;
+  }
+  else  {convRectFloat(buf, stride, kernel_float, kernel_size, kernel_size, result, tw, tw, th, false);}
+
+  for (int y = 0; y < th; y++)
+  {
+    double *dst = out.row(tile.row0 + y) + tile.col0;
+    for (int x = 0; x < tw; x++)  {dst[x] = result[y * tw + x];}
+  }
+
+  delete [] buf;
+  delete [] result;
+}
+
+
+/*
+fixed-point convolutional operation on one tile of the output
+  0-255 samples times weights scaled by 2^kernel_shift, summed exactly in 32 bits
+*/
+void convInt16(const Plane<double> &in, Plane<double> &out, const Tile &tile)
+{
+  int n = (kernel_size - 1) / 2;
+  int tw = tile.col1 - tile.col0;
+  int th = tile.row1 - tile.row0;
+  int stride = tw + 2 * n;
+  // the paired taps of an odd kernel read one sample past the last row
+  int16_t *buf = new int16_t [(th + 2 * n) * stride + 16];
+  int32_t *result = new int32_t [th * tw];
+  loadTile(in, tile, n, buf);
+  for (int i = (th + 2 * n) * stride; i < (th + 2 * n) * stride + 16; i++) {buf[i] = 0;}
+
+  convRectInt16(buf, stride, kernel_int16, kernel_size, kernel_size, result, tw, tw, th);
+
+  double scale = 1.0 / (255.0 * (1 << kernel_shift));
+  for (int y = 0; y < th; y++)
+  {
+    double *dst = out.row(tile.row0 + y) + tile.col0;
+    for (int x = 0; x < tw; x++)  {dst[x] = result[y * tw + x] * scale;}
+  }
+
+  delete [] buf;
+  delete [] result;
+}
+
+
+/*
+check whether the kernel is separable
+  factor the kernel with a one-sided Jacobi SVD, kernel = sum of s_k * u_k * v_k^T,
+  and keep the fewest terms whose reconstruction error is below the tolerance.
+  the kernel is run as separable passes only if that takes fewer taps than the full 2D kernel.
+*/
+void factorKernel()
+{
+  int k_n = kernel_size;
+  const double tolerance = 1e-6;  // max summed absolute error of the reconstructed kernel
+
+  // a constant kernel is a box filter, it runs on summed-area tables unless the box passes are already set
+  bool constant = (k_n > 0 and kernel[0][0] != 0);
+  for (int i = 0; i < k_n; i++)
+  {
+    for (int j = 0; j < k_n; j++)  {if (kernel[i][j] != kernel[0][0]) {constant = false;}}
+  }
+  if (constant and box_radii.empty())
+  {
+    box_radii.push_back((k_n - 1) / 2);
+    box_gain = kernel[0][0] * k_n * k_n;
+    cout << "Box Kernel: radius " << box_radii[0] << endl;
+  }
+
+  // one-sided Jacobi: orthogonalize the columns of a = kernel * v
+  double **a = new double *[k_n];
+  double **v = new double *[k_n];
+  for (int i = 0; i < k_n; i++)
+  {
+    a[i] = new double [k_n];
+    v[i] = new double [k_n];
+    for (int j = 0; j < k_n; j++)  {a[i][j] = kernel[i][j];  v[i][j] = (i == j) ? 1 : 0;}
+  }
+  for (int sweep = 0; sweep < 60; sweep++)
+  {
+    bool rotated = false;
+    for (int p = 0; p < k_n - 1; p++)
+    {
+      for (int q = p + 1; q < k_n; q++)
+      {
+        double alpha = 0, beta = 0, gamma = 0;
+        for (int i = 0; i < k_n; i++)
+        {
+          alpha += a[i][p] * a[i][p];
+          beta += a[i][q] * a[i][q];
+          gamma += a[i][p] * a[i][q];
+        }
+        if (gamma == 0 or fabs(gamma) <= 1e-15 * sqrt(alpha * beta))  {continue;}
+        rotated = true;
+        double zeta = (beta - alpha) / (2 * gamma);
+        double t = ((zeta >= 0) ? 1 : -1) / (fabs(zeta) + sqrt(1 + zeta * zeta));
+        double c = 1 / sqrt(1 + t * t);
+        double s = c * t;
+        for (int i = 0; i < k_n; i++)
+        {
+          double ap = a[i][p], aq = a[i][q];
+          a[i][p] = c * ap - s * aq;
+          a[i][q] = s * ap + c * aq;
+          double vp = v[i][p], vq = v[i][q];
+          v[i][p] = c * vp - s * vq;
+          v[i][q] = s * vp + c * vq;
+        }
+      }
+    }
+    if (!rotated) {break;}
+  }
+
+  // singular values are the column norms of a, sorted in descending order
+  int *order = new int [k_n];
+  double *sv = new double [k_n];
+  for (int j = 0; j < k_n; j++)
+  {
+    order[j] = j;
+    sv[j] = 0;
+    for (int i = 0; i < k_n; i++)  {sv[j] += a[i][j] * a[i][j];}
+    sv[j] = sqrt(sv[j]);
+  }
+  for (int j = 1; j < k_n; j++)
+  {
+    for (int l = j; l > 0 and sv[order[l]] > sv[order[l - 1]]; l--)  {swap(order[l], order[l - 1]);}
+  }
+
+  // find the lowest rank that reconstructs the kernel within the tolerance
+  // separable passes cost 2 * rank * kernel_size taps per pixel against kernel_size^2 for the 2D kernel
+  kernel_rank = 0;
+  int max_rank = use_separable ? k_n : 0;
+  double **residual = new double *[k_n];
+  for (int i = 0; i < k_n; i++)
+  {
+    residual[i] = new double [k_n];
+    for (int j = 0; j < k_n; j++)  {residual[i][j] = kernel[i][j];}
+  }
+  for (int r = 1; r <= max_rank and 2 * r * k_n < k_n * k_n; r++)
+  {
+    int idx = order[r - 1];
+    if (sv[idx] == 0) {break;}
+    // a[i][idx] = s * u[i], so the term s * u * v^T is a[i][idx] * v[j][idx]
+    double error = 0;
+    for (int i = 0; i < k_n; i++)
+    {
+      for (int j = 0; j < k_n; j++)
+      {
+        residual[i][j] -= a[i][idx] * v[j][idx];
+        error += fabs(residual[i][j]);
+      }
+    }
+    if (error <= tolerance) {kernel_rank = r;  break;}
+  }
+
+  if (kernel_rank > 0)
+  {
+    kernel_col = new double *[kernel_rank];
+    kernel_row = new double *[kernel_rank];
+    for (int k = 0; k < kernel_rank; k++)
+    {
+      kernel_col[k] = new double [k_n];
+      kernel_row[k] = new double [k_n];
+      for (int i = 0; i < k_n; i++)
+      {
+        kernel_col[k][i] = a[i][order[k]];
+        kernel_row[k][i] = v[i][order[k]];
+      }
+    }
+    cout << "Separable Kernel: rank " << kernel_rank << endl;
+  }
+  else  {cout << "Non-separable Kernel" << endl;}
+
+  // release memory
+  for (int i = 0; i < k_n; i++)  {delete [] a[i];  delete [] v[i];  delete [] residual[i];}
+  delete [] a;
+  delete [] v;
+  delete [] residual;
+  delete [] order;
+  delete [] sv;
+}
+
+
+/*
+release the flipped kernels of the reduced precision paths
+*/
+static void releaseReducedKernel()
+{
+  delete [] kernel_float;
+  delete [] kernel_row_float;
+  delete [] kernel_col_float;
+  delete [] kernel_int16;
+  kernel_float = kernel_row_float = kernel_col_float = NULL;
+  kernel_int16 = NULL;
+}
+
+
+/*
+build the flipped kernel of the reduced precision paths
+  float: kernel_float[i * kernel_size + j] = kernel[kernel_size - 1 - i][kernel_size - 1 - j], same for the separable factors
+  int16: the flipped kernel times 2^kernel_shift, the largest scale where every weight fits in 16 bits
+         and no sum of 0-255 samples can overflow 32 bits
+  runs once per filtered image, the copies of the previous image are released first
+*/
+void prepareReducedKernel()
+{
+  releaseReducedKernel();
+  int k_n = kernel_size;
+  if (precision == PRECISION_FLOAT)
+  {
+    kernel_float = new float [k_n * k_n];
+    for (int i = 0; i < k_n; i++)
+    {
+      for (int j = 0; j < k_n; j++)  {kernel_float[i * k_n + j] = kernel[k_n - 1 - i][k_n - 1 - j];}
+    }
+    kernel_row_float = new float [max(kernel_rank, 1) * k_n];
+    kernel_col_float = new float [max(kernel_rank, 1) * k_n];
+    for (int k = 0; k < kernel_rank; k++)
+    {
+      for (int i = 0; i < k_n; i++)
+      {
+        kernel_row_float[k * k_n + i] = kernel_row[k][k_n - 1 - i];
+        kernel_col_float[k * k_n + i] = kernel_col[k][k_n - 1 - i];
+      }
+    }
+  }
+  if (precision == PRECISION_INT16)
+  {
+    double largest = 0, total = 0;
+    for (int i = 0; i < k_n; i++)
+    {
+      for (int j = 0; j < k_n; j++)  {largest = max(largest, fabs(kernel[i][j]));  total += fabs(kernel[i][j]);}
+    }
+    kernel_shift = 0;
+    while (kernel_shift < 30 and largest * (1 << (kernel_shift + 1)) <= 32767 and total * 255 * (1 << (kernel_shift + 1)) < 2147483647.0)
+    {
+      kernel_shift++;
+    }
+    kernel_int16 = new int16_t [k_n * k_n];
+    for (int i = 0; i < k_n; i++)
+    {
+      for (int j = 0; j < k_n; j++)  {kernel_int16[i * k_n + j] = lrint(kernel[k_n - 1 - i][k_n - 1 - j] * (1 << kernel_shift));}
+    }
+    cout << "Fixed Point Scale: 2^" << kernel_shift << endl;
+  }
+}
+
+
+/*
+store one row of 8 bit interleaved pixels on scale 0-1 in row y of the channel planes or of the interleaved plane
+  the left and right apron of the row is reflected, rows above and below are left to the caller
+*/
+void loadRow(const unsigned char *src, Plane<double> *planes, bool interleaved, int y)
+{
+  if (interleaved)
+  {
+    double *dst = planes[0].row(y);
+    for (int i = 0; i < xres * inputChannels; i++)  {dst[i] = float(src[i]) / 255;}
+    planes[0].reflectColumns(y);
+    return;
+  }
+  for (int channel = 0; channel < inputChannels; channel++)
+  {
+    double *dst = planes[channel].row(y);
+    // store the channel value on scale 0-1
+    for (int col = 0; col < xres; col++)  {dst[col] = float(src[col * inputChannels + channel]) / 255;}
+    planes[channel].reflectColumns(y);
+  }
+}
+
+
+/*
+split the input pixmap into one plane per channel on scale 0-1
+  the planes are shared by every kernel applied to the image,
+  their border apron covers the largest kernel radius
+*/
+void splitChannels()
+{
+  channel_planes = new Plane<double> [inputChannels];
+  for (int channel = 0; channel < inputChannels; channel++)  {channel_planes[channel].allocate(xres, yres, plane_border);}
+  for (int row = 0; row < yres; row++)  {loadRow(inputpixmap + row * xres * inputChannels, channel_planes, false, row);}
+  for (int channel = 0; channel < inputChannels; channel++)  {channel_planes[channel].reflectBorder();}
+}
+
+
+/*
+copy the input pixmap into one interleaved plane on scale 0-1, shared like the channel planes
+*/
+void interleaveChannels()
+{
+  interleaved_plane = new Plane<double> (xres, yres, plane_border, inputChannels);
+  for (int row = 0; row < yres; row++)  {loadRow(inputpixmap + row * xres * inputChannels, interleaved_plane, true, row);}
+  interleaved_plane->reflectBorder();
+}
+
+
+/*
+release the channel planes and the cached input spectra and summed-area tables
+*/
+void releaseChannels()
+{
+  delete [] channel_planes;
+  channel_planes = NULL;
+  delete interleaved_plane;
+  interleaved_plane = NULL;
+  for (size_t i = 0; i < input_spectra.size(); i++)  {delete [] input_spectra[i];}
+  input_spectra.clear();
+  delete [] channel_sats;
+  channel_sats = NULL;
+}
+
+
+/*
+FFT convolution size: the image with a reflected border of pad pixels on each side,
+rounded up to powers of two. The circular convolution never wraps into the pixels we keep
+as long as the kernel radius is not larger than pad.
+*/
+void fftSize(int pad, int &pw, int &ph)
+{
+  pw = nextPowerOfTwo(xres + 2 * pad);
+  ph = nextPowerOfTwo(yres + 2 * pad);
+}
+
+
+/*
+decide between FFT and direct convolution from the estimated operation counts
+  direct: a multiply and an add per kernel tap per pixel
+  FFT: about 5 N log2(N) operations per 2D transform of N points, two channels share a forward and an inverse transform
+  the forward transforms of the input are not counted if they are already cached
+*/
+bool useFFT(int pad)
+{
+  if (conv_method == CONV_FFT)  {return true;}
+  if (conv_method == CONV_DIRECT) {return false;}
+
+  int pw, ph;
+  fftSize(pad, pw, ph);
+  double taps = (kernel_rank > 0) ? 2.0 * kernel_rank * kernel_size : double(kernel_size) * kernel_size;
+  double direct_cost = 2.0 * xres * yres * taps;
+  double points = double(pw) * ph;
+  double transforms = input_spectra.empty() ? 2 : 1;
+  double fft_cost = transforms * 2.5 * points * log2(points) + 8.0 * points;
+  // transforms walk the whole padded plane several times with poor locality, weigh them by 2
+  return 2 * fft_cost < direct_cost;
+}
+
+
+/*
+spectrum of the kernel placed at the origin of a pw x ph plane, from the kernel cache if it holds it
+*/
+Complex *kernelSpectrum(int pw, int ph, ThreadPool &pool)
+{
+  Complex *spectrum = loadCachedSpectrum(pw, ph);
+  if (spectrum) {return spectrum;}
+  spectrum = new Complex [pw * ph];
+  for (int row = 0; row < kernel_size; row++)
+  {
+    for (int col = 0; col < kernel_size; col++)  {spectrum[row * pw + col] = kernel[row][col];}
+  }
+  fft2D(spectrum, pw, ph, false, pool);
+  saveCachedSpectrum(spectrum, pw, ph);
+  return spectrum;
+}
+
+
+/*
+spectrum of up to two channels with reflected borders of pad pixels
+  the two real channels travel together as the real and imaginary part of one complex plane
+  in_b is NULL if there is only one channel, the plane borders must hold at least pad pixels
+*/
+Complex *inputSpectrum(const Plane<double> *in_a, const Plane<double> *in_b, int pad, int pw, int ph, ThreadPool &pool)
+{
+  Complex *spectrum = new Complex [pw * ph];
+  pool.parallelFor(yres + 2 * pad, [&](int y)
+  {
+    const double *a = in_a->row(y - pad) - pad;
+    const double *b = in_b ? in_b->row(y - pad) - pad : NULL;
+    for (int x = 0; x < xres + 2 * pad; x++)  {spectrum[y * pw + x] = Complex(a[x], b ? b[x] : 0);}
+  });
+  fft2D(spectrum, pw, ph, false, pool);
+  return spectrum;
+}
+
+
+/*
+FFT convolutional operation for up to two channels from their cached spectrum
+  the kernel is real so the two results come back separated in the real and imaginary part
+  out_b is NULL if there is only one channel
+*/
+void convFFT(const Complex *input_spectrum, const Complex *kernel_spectrum, Plane<double> *out_a, Plane<double> *out_b, int pad, int pw, int ph, ThreadPool &pool)
+{
+  int n = (kernel_size - 1) / 2;
+  Complex *plane = new Complex [pw * ph];
+
+  pool.parallelFor(ph, [&](int row)
+  {
+    for (int col = 0; col < pw; col++) {plane[row * pw + col] = input_spectrum[row * pw + col] * kernel_spectrum[row * pw + col];}
+  });
+  fft2D(plane, pw, ph, true, pool);
+
+  // output pixel (row, col) is at (row + pad + n, col + pad + n) of the full convolution
+  pool.parallelFor(yres, [&](int row)
+  {
+    const Complex *v = plane + (row + pad + n) * pw + pad + n;
+    double *a = out_a->row(row);
+    for (int col = 0; col < xres; col++)  {a[col] = v[col].real();}
+    if (out_b)
+    {
+      double *b = out_b->row(row);
+      for (int col = 0; col < xres; col++)  {b[col] = v[col].imag();}
+    }
+  });
+
+  delete [] plane;
+}
+
+
+/*
+summed-area table of a plane and its border apron
+  sat.row(y)[x] is the sum of the input rows -border ... y - border - 1 and columns -border ... x - border - 1,
+  row 0 and column 0 are zero. Rows are summed in parallel, then strips of columns.
+*/
+void buildSAT(const Plane<double> &in, Plane<double> &sat, ThreadPool &pool)
+{
+  int b = in.border();
+  int w = in.width() + 2 * b;
+  int h = in.height() + 2 * b;
+  sat.allocate(w + 1, h + 1);
+  pool.parallelFor(h + 1, [&](int y)
+  {
+    double *dst = sat.row(y);
+    dst[0] = 0;
+    if (y == 0)
+    {
+      for (int x = 1; x <= w; x++)  {dst[x] = 0;}
+      return;
+    }
+    const double *src = in.row(y - 1 - b) - b;
+    double sum = 0;
+    for (int x = 0; x < w; x++)  {sum += src[x];  dst[x + 1] = sum;}
+  });
+  const int strip = 256;  // columns per task, the rows of a strip stay in the L1 cache
+  pool.parallelFor((w + strip) / strip, [&](int s)
+  {
+    int x0 = s * strip;
+    int x1 = min(x0 + strip, w + 1);
+    for (int y = 1; y <= h; y++)
+    {
+      double *dst = sat.row(y);
+      const double *above = sat.row(y - 1);
+      for (int x = x0; x < x1; x++)  {dst[x] += above[x];}
+    }
+  });
+}
+
+
+/*
+one box filter pass from a summed-area table: out = weight times the sum over the (2 radius + 1)^2 window
+  border is the border of the plane the table was built from, it holds at least the radius
+*/
+void boxPass(const Plane<double> &sat, int border, int radius, double weight, Plane<double> &out, ThreadPool &pool)
+{
+  pool.parallelFor(yres, [&](int y)
+  {
+    const double *top = sat.row(y - radius + border);
+    const double *bottom = sat.row(y + radius + 1 + border);
+    double *dst = out.row(y);
+    for (int x = 0; x < xres; x++)
+    {
+      int x0 = x - radius + border;
+      int x1 = x + radius + 1 + border;
+      dst[x] = weight * ((bottom[x1] - top[x1]) - (bottom[x0] - top[x0]));
+    }
+  });
+}
+
+
+/*
+box filter passes of the current kernel over one channel, the cost per pixel does not depend on the radius
+  the first pass reads the cached summed-area table of the channel plane,
+  every further pass reflects the previous result and builds a table from it
+*/
+void convBox(int channel, Plane<double> &out, ThreadPool &pool)
+{
+  Plane<double> stage[2];   // results of the passes before the last one, with a reflected border
+  Plane<double> stage_sat;
+  const Plane<double> *sat = &channel_sats[channel];
+  int border = plane_border;
+  int passes = box_radii.size();
+  for (int p = 0; p < passes; p++)
+  {
+    int r = box_radii[p];
+    double weight = 1.0 / ((2 * r + 1) * (2 * r + 1));
+    if (p == passes - 1)
+    {
+      boxPass(*sat, border, r, weight * box_gain, out, pool);
+      break;
+    }
+    Plane<double> &next = stage[p % 2];
+    next.allocate(xres, yres, box_radii[p + 1]);
+    boxPass(*sat, border, r, weight, next, pool);
+    next.reflectBorder();
+    buildSAT(next, stage_sat, pool);
+    sat = &stage_sat;
+    border = next.border();
+  }
+}
+
+
+/*
+cut rows [0, rows) of the image into tiles, each tile is filtered independently
+*/
+vector<Tile> makeTiles(int rows)
+{
+  vector<Tile> tiles;
+  for (int row = 0; row < rows; row += TILE_SIZE)
+  {
+    for (int col = 0; col < xres; col += TILE_SIZE)
+    {
+      Tile tile;
+      tile.row0 = row;
+      tile.row1 = min(row + TILE_SIZE, rows);
+      tile.col0 = col;
+      tile.col1 = min(col + TILE_SIZE, xres);
+      tiles.push_back(tile);
+    }
+  }
+  return tiles;
+}
+
+
+/*
+direct convolution of rows [0, rows) of the input planes into the 8 bit pixels of those rows
+  in is the interleaved plane or one plane per channel, their border holds at least the kernel radius
+*/
+void filterDirect(const Plane<double> *in, bool interleaved, int rows, unsigned char *pixels, ThreadPool &pool)
+{
+  vector<Tile> tiles = makeTiles(rows);
+  if (interleaved)
+  {
+    Plane<double> out_pixels(xres, rows, 0, inputChannels);
+    pool.parallelFor(tiles.size(), [&](int t)  {convInterleavedTile(in[0], out_pixels, tiles[t]);});
+    for (int row = 0; row < rows; row++)
+    {
+      const double *src = out_pixels.row(row);
+      unsigned char *dst = pixels + row * xres * inputChannels;
+      // scale the output value to 0-255: 255 times the absolute value
+      for (int i = 0; i < xres * inputChannels; i++)  {dst[i] = 255 * abs(src[i]);}
+    }
+    return;
+  }
+
+  Plane<double> out_value(xres, rows);
+  for (int channel = 0; channel < inputChannels; channel++)
+  {
+    // every output pixel is computed the same way whatever the tile and thread, so the result does not depend on the thread count
+    pool.parallelFor(tiles.size(), [&](int t)
+    {
+      if (precision == PRECISION_FLOAT) {convFloat(in[channel], out_value, tiles[t]);}
+      else if (precision == PRECISION_INT16)  {convInt16(in[channel], out_value, tiles[t]);}
+      else if (convFixedSize<1>(in[channel], out_value, tiles[t]))  {}
+      else if (kernel_rank > 0)  {convSeparable(in[channel], out_value, tiles[t]);}
+      else  {conv(in[channel], out_value, tiles[t]);}
+    });
+    for (int row = 0; row < rows; row++)
+    {
+      const double *src = out_value.row(row);
+      unsigned char *dst = pixels + row * xres * inputChannels + channel;
+      // scale the output value to 0-255: 255 times the absolute value
+      for (int col = 0; col < xres; col++)  {dst[col * inputChannels] = 255 * abs(src[col]);}
+    }
+  }
+}
+
+
+/*
+filter the shared input planes with the current kernel into the output pixmap
+  the planes are built the first time a kernel needs them, with a border of plane_border pixels
+*/
+void filterImage(ThreadPool &pool)
+{
+  outputpixmap = new unsigned char [xres * yres * inputChannels];
+  
+  int pad = plane_border;
+  // box filters run on summed-area tables unless a method is forced
+  bool box = (!box_radii.empty() and conv_method == CONV_AUTO and precision == PRECISION_DOUBLE);
+  bool fft = (!box and useFFT(pad));
+  // the double precision direct path filters all channels of a pixel together
+  bool interleaved = (!box and !fft and precision == PRECISION_DOUBLE and inputChannels >= 2 and inputChannels <= 4);
+  if (interleaved and !interleaved_plane) {interleaveChannels();}
+  if (!interleaved and !channel_planes) {splitChannels();}
+
+  if (box)
+  {
+    cout << "Convolution: box passes " << box_radii.size() << " Threads: " << pool.size() << endl;
+    // the summed-area tables only depend on the image and pad, build them once for all kernels
+    if (!channel_sats)
+    {
+      channel_sats = new Plane<double> [inputChannels];
+      for (int channel = 0; channel < inputChannels; channel++)  {buildSAT(channel_planes[channel], channel_sats[channel], pool);}
+    }
+    Plane<double> out_value(xres, yres);
+    for (int channel = 0; channel < inputChannels; channel++)
+    {
+      convBox(channel, out_value, pool);
+      for (int row = 0; row < yres; row++)
+      {
+        const double *src = out_value.row(row);
+        unsigned char *dst = outputpixmap + row * xres * inputChannels + channel;
+        // scale the output value to 0-255: 255 times the absolute value
+        for (int col = 0; col < xres; col++)  {dst[col * inputChannels] = 255 * abs(src[col]);}
+      }
+    }
+    return;
+  }
+
+  if (!fft)
+  {
+    prepareReducedKernel();
+    cout << "Convolution: direct " << precisionName() << (interleaved ? " interleaved" : "") << " Threads: " << pool.size() << " Tiles: " << makeTiles(yres).size() << endl;
+    filterDirect(interleaved ? interleaved_plane : channel_planes, interleaved, yres, outputpixmap, pool);
+    return;
+  }
+
+  int pw = 0, ph = 0;
+  fftSize(pad, pw, ph);
+  Complex *spectrum = kernelSpectrum(pw, ph, pool);
+  // the input spectra only depend on the image and pad, compute them once for all kernels
+  if (input_spectra.empty())
+  {
+    for (int channel = 0; channel < inputChannels; channel += 2)
+    {
+      const Plane<double> *in_b = (channel + 1 < inputChannels) ? &channel_planes[channel + 1] : NULL;
+      input_spectra.push_back(inputSpectrum(&channel_planes[channel], in_b, pad, pw, ph, pool));
+    }
+  }
+  cout << "Convolution: FFT " << pw << "X" << ph << " Threads: " << pool.size() << endl;
+
+  // the FFT path filters two channels at a time
+  Plane<double> out_value[2];
+  for (int p = 0; p < min(2, inputChannels); p++)  {out_value[p].allocate(xres, yres);}
+  for (int channel = 0; channel < inputChannels; channel += 2)
+  {
+    int count = min(2, inputChannels - channel);
+    convFFT(input_spectra[channel / 2], spectrum, &out_value[0], (count > 1) ? &out_value[1] : NULL, pad, pw, ph, pool);
+    for (int p = 0; p < count; p++)
+    {
+      for (int row = 0; row < yres; row++)
+      {
+        const double *src = out_value[p].row(row);
+        unsigned char *dst = outputpixmap + row * xres * inputChannels + channel + p;
+        // scale the output value to 0-255: 255 times the absolute value
+        for (int col = 0; col < xres; col++)  {dst[col * inputChannels] = 255 * abs(src[col]);}
+      }
+    }
+  }
+  
+  // release memory
+  delete [] spectrum;
+}
+
+
+/*
+filter an image that arrives and leaves one row at a time, without holding the whole image
+  read_row(y, pixels) delivers the 8 bit interleaved pixels of input row y, rows are asked for in order
+  write_rows(y0, y1, pixels) takes the filtered rows [y0, y1)
+  the image is filtered in bands of TILE_SIZE rows: a band and the kernel radius above and below it
+  are kept on scale 0-1, the raw input rows in a ring of the same height.
+  memory is O(width x (TILE_SIZE + kernel_size)) whatever the image height, FFT convolution is not available.
+*/
+void filterStream(const function<void(int, unsigned char *)> &read_row, const function<void(int, int, const unsigned char *)> &write_rows, ThreadPool &pool)
+{
+  int n = (kernel_size - 1) / 2;
+  int band = TILE_SIZE;
+  int ring_rows = band + 2 * n;
+  int row_size = xres * inputChannels;
+  bool interleaved = (precision == PRECISION_DOUBLE and inputChannels >= 2 and inputChannels <= 4);
+  if (conv_method == CONV_FFT)  {cout << "FFT convolution needs the whole image, streaming runs direct convolution" << endl;}
+  prepareReducedKernel();
+  cout << "Convolution: direct " << precisionName() << (interleaved ? " interleaved" : "") << " Threads: " << pool.size() << " Streaming bands: " << band << " rows" << endl;
+
+  // ring of raw input rows: input row y is in slot y % ring_rows
+  unsigned char *ring = new unsigned char [ring_rows * row_size];
+  unsigned char *pixels = new unsigned char [band * row_size];
+  int nplanes = interleaved ? 1 : inputChannels;
+  Plane<double> *planes = new Plane<double> [nplanes];
+  for (int p = 0; p < nplanes; p++)  {planes[p].allocate(xres, band, n, interleaved ? inputChannels : 1);}
+
+  int next_row = 0;   // next input row to read
+  for (int y0 = 0; y0 < yres; y0 += band)
+  {
+    int rows = min(band, yres - y0);
+    // the rows of a band and the rows reflected into its borders all lie within the last ring_rows rows read
+    for (; next_row <= min(y0 + rows - 1 + n, yres - 1); next_row++)  {read_row(next_row, ring + (next_row % ring_rows) * row_size);}
+    for (int y = -n; y < rows + n; y++)
+    {
+      int source = reflectIndex(y0 + y, yres);
+      loadRow(ring + (source % ring_rows) * row_size, planes, interleaved, y);
+    }
+    filterDirect(planes, interleaved, rows, pixels, pool);
+    write_rows(y0, y0 + rows, pixels);
+  }
+
+  // release memory
+  delete [] ring;
+  delete [] pixels;
+  delete [] planes;
+}
+
+
+/*
+release the current kernel and its separable factors
+*/
+void releaseKernel()
+{
+  for (int i = 0; kernel and i < kernel_size; i++)  {delete [] kernel[i];}
+  delete [] kernel;
+  kernel = NULL;
+  kernel_size = 0;
+  for (int k = 0; k < kernel_rank; k++)  {delete [] kernel_col[k];  delete [] kernel_row[k];}
+  if (kernel_rank > 0)  {delete [] kernel_col;  delete [] kernel_row;}
+  kernel_rank = 0;
+  releaseReducedKernel();
+  box_radii.clear();
+  box_gain = 1;
+  kernel_key = "";
+}
+
+
+/*
+get filter kernel from filter file
+*/
+void readfilter(string filterfile)
+{
+  fstream filterFile(filterfile.c_str());
+  // get kernel size
+  double scale_factor;  // debug: scale_factor can't be int
+  filterFile >> kernel_size >> scale_factor;
+  if (!filterFile or kernel_size < 1)
+  {
+    cerr << "Cannot read a kernel size of at least 1 from the filter file " << filterfile << endl;
+    exit(0);
+  }
+  // allocate memory for kernel 2D-array
+  kernel = new double *[kernel_size];
+  for (int i = 0; i < kernel_size; i++)
+  {
+    kernel[i] = new double [kernel_size];
+  }
+  // get kernel values
+  double positive_sum = 0;
+  double negative_sum = 0;
+  cout << "Kernel Size: " << kernel_size << endl;
+  cout << "Kernel " << filterfile << ": " << endl;
+  for (int row = 0; row < kernel_size; row++)
+  {
+    for (int col = 0; col < kernel_size; col++)
+    {
+      filterFile >> kernel[row][col];
+      cout << kernel[row][col] << " ";
+      if (kernel[row][col] > 0) {positive_sum += kernel[row][col];}
+      else  {negative_sum += (-kernel[row][col]);}
+    }
+    cout << endl;
+  }
+  // kernel normalization
+  double scale = (positive_sum > negative_sum) ? positive_sum : negative_sum;
+  cout << "Scale Factor: " << scale << endl;
+  for (int row = 0; row < kernel_size; row++)
+  {
+    for (int col = 0; col < kernel_size; col++)
+    {
+      kernel[row][col] = kernel[row][col] / scale;
+    }
+  }
+}
+
+
+/*
+calculate gabor filter kernel with a kernel size n/m = 2 * sigma 
+*/
+void getGaborFilter(double theta, double sigma, double T)
+{
+  int kernel_center;
+  kernel_size = 4 * sigma + 1;
+  kernel_center = 2 * sigma;
+  kernel = new double *[kernel_size];
+  for (int i = 0; i < kernel_size; i++)  {kernel[i] = new double [kernel_size];}
+  
+  cout << "Kernel Size: " << kernel_size << endl;
+  cout << "Gabor Kernel: " << endl;
+  double positive_sum = 0;
+  double negative_sum = 0;
+  for (int row = 0; row < kernel_size; row++)
+  {
+    for (int col = 0; col < kernel_size; col++)
+    {
+      double x, y, xx, yy;
+      // calculate the distance to kernel center
+      x = (col > 0) ? ((col + 0.5) - kernel_center) : ((col - 0.5) - kernel_center);
+      y = (row > 0) ? ((row + 0.5) - kernel_center) : ((row - 0.5) - kernel_center);
+   
+      xx = x * cos(theta * M_PI / 180) + y * sin(theta * M_PI / 180);
+      yy = -x * sin(theta * M_PI / 180) + y * cos(theta * M_PI / 180);
+      kernel[row][col] = exp(-(pow(xx, 2.0) + pow(yy, 2.0)) / (2 * pow(sigma, 2.0))) * cos(2 * M_PI * xx / T);
+
+      if (kernel[row][col] > 0) {positive_sum += kernel[row][col];}
+      else  {negative_sum += (-kernel[row][col]);}
+
+      cout << setprecision(2) << kernel[row][col] << " ";
+    }
+    cout << endl;
+  }
+
+  double scale = (positive_sum > negative_sum) ? positive_sum : negative_sum;
+  cout << "Scale Factor: " << scale << endl;
+  for (int row = 0; row < kernel_size; row++)
+  {
+    for (int col = 0; col < kernel_size; col++)
+    {
+      kernel[row][col] = kernel[row][col] / scale;
+    }
+  }
+}
+
+
+/*
+box filter kernel: (2 radius + 1)^2 equal weights summing to 1
+*/
+void getBoxFilter(int radius)
+{
+  kernel_size = 2 * radius + 1;
+  kernel = new double *[kernel_size];
+  for (int i = 0; i < kernel_size; i++)
+  {
+    kernel[i] = new double [kernel_size];
+    for (int j = 0; j < kernel_size; j++)  {kernel[i][j] = 1.0 / (kernel_size * kernel_size);}
+  }
+  cout << "Kernel Size: " << kernel_size << endl;
+  cout << "Box Kernel: radius " << radius << endl;
+}
+
+
+/*
+radii of three box filters whose repeated application approximates a Gaussian of the given sigma
+  the widths are the odd numbers around the ideal width sqrt(12 sigma^2 / 3 + 1), mixed so the variances add up to sigma^2
+*/
+vector<int> boxGaussianRadii(double sigma)
+{
+  const int passes = 3;
+  double ideal = sqrt(12 * sigma * sigma / passes + 1);
+  int lower = floor(ideal);
+  if (lower % 2 == 0) {lower--;}
+  if (lower < 1)  {lower = 1;}
+  int upper = lower + 2;
+  int m = lrint((12 * sigma * sigma - passes * lower * lower - 4 * passes * lower - 3 * passes) / (-4.0 * lower - 4));
+  m = max(0, min(passes, m));
+  vector<int> radii;
+  for (int p = 0; p < passes; p++)  {radii.push_back(((p < m) ? lower : upper) / 2);}
+  return radii;
+}
+
+
+/*
+Gaussian approximated by iterated box filters
+  kernel holds the exact combined kernel, the outer product of the convolved 1D boxes, for the other methods,
+  the box passes run in constant time per pixel
+*/
+void getBoxGaussian(double sigma)
+{
+  vector<int> radii = boxGaussianRadii(sigma);
+  // convolve the 1D boxes
+  vector<double> profile(1, 1.0);
+  for (size_t p = 0; p < radii.size(); p++)
+  {
+    int width = 2 * radii[p] + 1;
+    vector<double> next(profile.size() + width - 1, 0.0);
+    for (size_t i = 0; i < profile.size(); i++)
+    {
+      for (int j = 0; j < width; j++)  {next[i + j] += profile[i] / width;}
+    }
+    profile.swap(next);
+  }
+
+  kernel_size = profile.size();
+  kernel = new double *[kernel_size];
+  for (int i = 0; i < kernel_size; i++)
+  {
+    kernel[i] = new double [kernel_size];
+    for (int j = 0; j < kernel_size; j++)  {kernel[i][j] = profile[i] * profile[j];}
+  }
+  box_radii = radii;
+  box_gain = 1;
+  cout << "Kernel Size: " << kernel_size << endl;
+  cout << "Box Gaussian: sigma " << sigma << " radii";
+  for (size_t p = 0; p < radii.size(); p++)  {cout << " " << radii[p];}
+  cout << endl;
+}
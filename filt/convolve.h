@@ -0,0 +1,61 @@
+/*
+Convolution engine of filt: kernels, input planes and the direct, separable, interleaved,
+reduced precision and FFT convolution paths.
+
+Usage: set the image (inputpixmap, xres, yres, inputChannels), load a kernel with
+readfilter() or getGaborFilter(), factorKernel(), set plane_border to at least the kernel radius,
+then filterImage() fills outputpixmap. releaseChannels() before the next image, releaseKernel() before the next kernel.
+filterStream() filters an image row by row without inputpixmap and outputpixmap, it only needs xres, yres and inputChannels.
+
+Jingcong Zhang
+jingcoz@g.clemson.edu
+*/
+
+# ifndef CONVOLVE_H
+# define CONVOLVE_H
+
+# include <string>
+# include <functional>
+# include <vector>
+
+# include "threadpool.h"
+
+enum ConvMethod {CONV_AUTO, CONV_DIRECT, CONV_FFT};
+enum Precision {PRECISION_DOUBLE, PRECISION_FLOAT, PRECISION_INT16};
+
+// image to filter and the filtered image, interleaved 8 bit channels
+extern unsigned char *inputpixmap;
+extern unsigned char *outputpixmap;
+extern int inputChannels;
+extern int xres, yres;
+
+// current kernel
+extern double **kernel;
+extern int kernel_size;
+extern int kernel_rank;   // number of separable terms, 0 if the kernel runs as a full 2D kernel
+extern double **kernel_col;   // separable factors: kernel[i][j] ~ sum of kernel_col[k][i] * kernel_row[k][j]
+extern double **kernel_row;
+extern std::vector<int> box_radii;   // radii of the box filter passes equal to the kernel, empty if it is not made of boxes
+extern double box_gain;   // scale of the last box pass
+
+// filter settings
+extern ConvMethod conv_method;
+extern Precision precision;
+extern bool use_separable;   // let factorKernel() run low rank kernels as separable passes
+extern bool use_fixed_kernels;   // run 3x3, 5x5 and 7x7 kernels on the unrolled 2D routines, even when separable
+extern int plane_border;   // reflected border of the input planes: the largest kernel radius
+
+void readfilter(std::string filterfile);
+void getGaborFilter(double theta, double sigma, double T);
+void getBoxFilter(int radius);
+void getBoxGaussian(double sigma);
+std::vector<int> boxGaussianRadii(double sigma);
+void factorKernel();
+void releaseKernel();
+
+void filterImage(ThreadPool &pool);
+void filterStream(const std::function<void(int, unsigned char *)> &read_row, const std::function<void(int, int, const unsigned char *)> &write_rows, ThreadPool &pool);
+void releaseChannels();
+std::string precisionName();
+
+# endif
@@ -0,0 +1,101 @@
+/*
+Self-contained radix-2 fast Fourier transform for the FFT convolution mode of filt.
+
+Jingcong Zhang
+jingcoz@g.clemson.edu
+*/
+
+# include "fft.h"
+# include <cmath>
+
+using namespace std;
+
+
+int nextPowerOfTwo(int n)
+{
+  int p = 1;
+  while (p < n) {p *= 2;}
+  return p;
+}
+
+
+FFTPlan::FFTPlan(int size)
+{
+  n = size;
+  twiddle.resize(n / 2);
+  // compute every factor directly instead of by recurrence to keep the rounding error flat
+  for (int k = 0; k < n / 2; k++)  {twiddle[k] = Complex(cos(2 * M_PI * k / n), -sin(2 * M_PI * k / n));}
+
+  int bits = 0;
+  while ((1 << bits) < n) {bits++;}
+  reversed.resize(n);
+  for (int i = 0; i < n; i++)
+  {
+    int r = 0;
+    for (int b = 0; b < bits; b++) {if (i & (1 << b)) {r |= 1 << (bits - 1 - b);}}
+    reversed[i] = r;
+  }
+}
+
+
+/*
+iterative Cooley-Tukey transform
+*/
+void FFTPlan::transform(Complex *data, int stride, bool inverse) const
+{
+  for (int i = 0; i < n; i++)
+  {
+    int r = reversed[i];
+    if (r > i)  {swap(data[i * stride], data[r * stride]);}
+  }
+
+  for (int len = 2; len <= n; len *= 2)
+  {
+    int half = len / 2;
+    int step = n / len;
+    for (int start = 0; start < n; start += len)
+    {
+      for (int k = 0; k < half; k++)
+      {
+        Complex w = inverse ? conj(twiddle[k * step]) : twiddle[k * step];
+        Complex &a = data[(start + k) * stride];
+        Complex &b = data[(start + k + half) * stride];
+        Complex t = w * b;
+        b = a - t;
+        a = a + t;
+      }
+    }
+  }
+
+  if (inverse)
+  {
+    double scale = 1.0 / n;
+    for (int i = 0; i < n; i++) {data[i * stride] *= scale;}
+  }
+}
+
+
+void fft2D(Complex *data, int width, int height, bool inverse, ThreadPool &pool)
+{
+  FFTPlan row_plan(width);
+  FFTPlan col_plan(height);
+
+  pool.parallelFor(height, [&](int row)
+  {
+    row_plan.transform(data + row * width, 1, inverse);
+  });
+  // columns are copied out to a contiguous buffer so the butterflies do not stride across rows
+  const int group = 8;  // columns moved per task
+  pool.parallelFor((width + group - 1) / group, [&](int task)
+  {
+    int col0 = task * group;
+    int cols = min(group, width - col0);
+    vector<Complex> column(height);
+    for (int c = col0; c < col0 + cols; c++)
+    {
+      for (int row = 0; row < height; row++)  {column[row] = data[row * width + c];}
+      col_plan.transform(&column[0], 1, inverse);
+      for (int row = 0; row < height; row++)  {data[row * width + c] = column[row];}
+    }
+  });
+}
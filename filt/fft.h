@@ -0,0 +1,40 @@
+/*
+Self-contained radix-2 fast Fourier transform for the FFT convolution mode of filt.
+Transform sizes must be powers of two.
+
+Jingcong Zhang
+jingcoz@g.clemson.edu
+*/
+
+# ifndef FFT_H
+# define FFT_H
+
+# include <complex>
+# include <vector>
+
+# include "threadpool.h"
+
+typedef std::complex<double> Complex;
+
+int nextPowerOfTwo(int n);
+
+// precomputed twiddle factors and bit reversal permutation for one transform size
+class FFTPlan
+{
+public:
+  FFTPlan(int n);
+
+  int size() const {return n;}
+  // in-place transform of n values spaced stride apart, the inverse transform is scaled by 1/n
+  void transform(Complex *data, int stride, bool inverse) const;
+
+private:
+  int n;
+  std::vector<Complex> twiddle;   // exp(-2 pi i k / n), k = 0 ... n/2 - 1
+  std::vector<int> reversed;   // bit reversed index
+};
+
+// in-place 2D transform of a width x height row-major array, rows and columns run on the pool
+void fft2D(Complex *data, int width, int height, bool inverse, ThreadPool &pool);
+
+# endif
@@ -7,6 +7,27 @@ Usage:
   filt <input_image_file> <filter_file> <output_image_file>(optional)
 - Filter an image by Gabor filter generated from parameters
   filt <input_image_file> <output_image_file>(optional) -g <theta> <sigma> <period>
+- Filter an image by a box filter, or by a Gaussian approximated with three box filters
+  filt <input_image_file> <output_image_file>(optional) -box <radius>
+  filt <input_image_file> <output_image_file>(optional) -gauss <sigma>
+- Filter an image by a pipeline of kernels and point operations listed in a pipeline file
+  filt <input_image_file> <output_image_file>(optional) -pipeline <pipeline_file>
+- Filter an image by every kernel of a filter bank, output i is written to <output_image_file>_<i>
+  filt <input_image_file> <output_image_file> -bank <bank_file>
+- Filter every "<input_image_file> <output_image_file>" pair listed in a batch file without displaying anything,
+  with a filter file, a Gabor filter or a filter bank
+  filt --batch <batch_file> <filter_file>
+  filt --batch <batch_file> -g <theta> <sigma> <period>
+  filt --batch <batch_file> -box <radius> | -gauss <sigma>
+  filt --batch <batch_file> -bank <bank_file>
+  filt --batch <batch_file> -pipeline <pipeline_file>
+  filt_batch is the same program built without OpenGL and GLUT, it never displays the images
+- Options
+  -j <threads>  number of threads used to filter the image, default: all cores
+  -conv <auto|direct|fft>  convolution method, default: auto
+  -p <double|float|int16>  arithmetic of direct convolution, default: double
+  -stream  filter scanline by scanline straight into the output image, the images are never held in memory
+  -cache <dir>  keep normalized, factored kernels and their FFT spectra in a cache directory for later runs
 
 Mouse Response:
   Left click any of the displayed windows to quit the program.
@@ -26,228 +47,56 @@ jingcoz@g.clemson.edu
 # include <math.h>
 # include <cmath>
 # include <iomanip>
-
-# ifdef __APPLE__
-#   pragma clang diagnostic ignored "-Wdeprecated-declarations"
-#   include <GLUT/glut.h>
-# else
-#   include <GL/glut.h>
+# include <sstream>
+# include <vector>
+# include <thread>
+
+# include "threadpool.h"
+# include "convolve.h"
+# include "kernelcache.h"
+# include "pipeline.h"
+
+// FILT_NO_GL builds the headless filt_batch program without OpenGL and GLUT
+# ifndef FILT_NO_GL
+#   ifdef __APPLE__
+#     pragma clang diagnostic ignored "-Wdeprecated-declarations"
+#     include <GLUT/glut.h>
+#   else
+#     include <GL/glut.h>
+#   endif
 # endif
 
 using namespace std;
 OIIO_NAMESPACE_USING
 
 
-static unsigned char *inputpixmap;   // input image pixel map
-static unsigned char *outputpixmap;   // output image pixel map
-static double **kernel;   // 2D-array to store convolutional kernel
-static int inputChannels;   // color channel number of input image
-static int xres, yres;   // window size: image width, image height
-static int kernel_size;   // kernel size
-
-
-/*
-reflect image at borders
-*/
-int reflectBorder(int index, int total)
-{
-  int index_new;
-  index_new = index;  
-  if (index < 0)  {index_new = -index;}
-  if (index >= total) {index_new = 2 * (total - 1) - index;}
-
-  return index_new;
-}
-
-
-/*
-convolutional operation
-*/
-void conv(double **in, double **out)
-{
-  int n = (kernel_size - 1) / 2;
-  for (int row = -n; row < yres - n; row++)
-  {
-    for (int col = -n; col < xres - n; col++)
-    {
-      double sum = 0;
-      // inside boundary
-      if (row <= (yres - kernel_size) and row >= 0 and col <= (xres - kernel_size) and col >= 0)
-      {
-        for (int i = 0; i < kernel_size; i++)
-        {
-          for (int j = 0; j < kernel_size; j++)
-          {
-            sum += kernel[kernel_size - 1 - i][kernel_size - 1 - j] * in[row + i][col + j];
-          }
-        }
-      }
-      // boundary conditions
-      // reflect image at borders to add points for rows and cols outside the boundaries
-      else
-      {
-        for (int i = 0; i < kernel_size; i++)
-        {
-          for (int j = 0; j < kernel_size; j++)
-          {
-            sum += kernel[kernel_size - 1 - i][kernel_size - 1 - j] * in[reflectBorder(row + i, yres)][reflectBorder(col + j, xres)];
-          }
-        }
-      }
-      out[row + n][col + n] = sum;
-    }
-  }
-}
+static int nthreads;  // number of threads used to filter the image
 
+// kind of kernel of a filter bank entry
+enum KernelType {KERNEL_FILE, KERNEL_GABOR, KERNEL_BOX, KERNEL_BOX_GAUSSIAN};
 
-/*
-filter image for each channels
-*/
-void filterImage()
+// one entry of a filter bank: a filter file, a Gabor filter, a box filter or an iterated box Gaussian
+struct BankEntry
 {
-  outputpixmap = new unsigned char [xres * yres * inputChannels];
-  
-  int m = (xres > yres) ? xres : yres;
-  double **channel_value = new double *[m];
-  double **out_value = new double *[m];
-  for (int i = 0; i < m; i++)  
-  {
-    channel_value[i] = new double [m];
-    out_value[i] = new double [m];
-  }
-
-  // seperate channel values
-  for (int channel = 0; channel < inputChannels; channel++)
-  {
-    for (int row = 0; row < yres; row++)
-    {
-      for (int col = 0; col < xres; col++)
-      {
-        // store the channel value on scale 0-1
-        channel_value[row][col] = float(inputpixmap[(row * xres + col) * inputChannels + channel]) / 255;
-      }
-    }
-    conv(channel_value, out_value);
-    for (int row = 0; row < yres; row++)
-    {
-      for (int col = 0; col < xres; col++)
-      {
-        // scale the output value to 0-255: 255 times the absolute value
-        outputpixmap[(row * xres + col) * inputChannels + channel] = 255 * abs(out_value[row][col]);
-      }
-    }
-  }
-  
-  // release memory
-  for (int i = 0; i < m; i++)  {delete [] channel_value[i];  delete [] out_value[i];}
-  delete [] channel_value;
-  delete [] out_value;
-}
-
-
-/*
-get filter kernel from filter file
-*/
-void readfilter(string filterfile)
-{
-  fstream filterFile(filterfile.c_str());
-  // get kernel size
-  double scale_factor;  // debug: scale_factor can't be int
-  filterFile >> kernel_size >> scale_factor;
-  // allocate memory for kernel 2D-array
-  kernel = new double *[kernel_size];
-  for (int i = 0; i < kernel_size; i++)
-  {
-    kernel[i] = new double [kernel_size];
-  }
-  // get kernel values
-  double positive_sum = 0;
-  double negative_sum = 0;
-  cout << "Kernel Size: " << kernel_size << endl;
-  cout << "Kernel " << filterfile << ": " << endl;
-  for (int row = 0; row < kernel_size; row++)
-  {
-    for (int col = 0; col < kernel_size; col++)
-    {
-      filterFile >> kernel[row][col];
-      cout << kernel[row][col] << " ";
-      if (kernel[row][col] > 0) {positive_sum += kernel[row][col];}
-      else  {negative_sum += (-kernel[row][col]);}
-    }
-    cout << endl;
-  }
-  // kernel normalization
-  double scale = (positive_sum > negative_sum) ? positive_sum : negative_sum;
-  cout << "Scale Factor: " << scale << endl;
-  for (int row = 0; row < kernel_size; row++)
-  {
-    for (int col = 0; col < kernel_size; col++)
-    {
-      kernel[row][col] = kernel[row][col] / scale;
-    }
-  }
-}
-
-
-/*
-calculate gabor filter kernel with a kernel size n/m = 2 * sigma 
-*/
-void getGaborFilter(double theta, double sigma, double T)
-{
-  int kernel_center;
-  kernel_size = 4 * sigma + 1;
-  kernel_center = 2 * sigma;
-  kernel = new double *[kernel_size];
-  for (int i = 0; i < kernel_size; i++)  {kernel[i] = new double [kernel_size];}
-  
-  cout << "Kernel Size: " << kernel_size << endl;
-  cout << "Gabor Kernel: " << endl;
-  double positive_sum = 0;
-  double negative_sum = 0;
-  for (int row = 0; row < kernel_size; row++)
-  {
-    for (int col = 0; col < kernel_size; col++)
-    {
-      double x, y, xx, yy;
-      // calculate the distance to kernel center
-      x = (col > 0) ? ((col + 0.5) - kernel_center) : ((col - 0.5) - kernel_center);
-      y = (row > 0) ? ((row + 0.5) - kernel_center) : ((row - 0.5) - kernel_center);
-   
-      xx = x * cos(theta * M_PI / 180) + y * sin(theta * M_PI / 180);
-      yy = -x * sin(theta * M_PI / 180) + y * cos(theta * M_PI / 180);
-      kernel[row][col] = exp(-(pow(xx, 2.0) + pow(yy, 2.0)) / (2 * pow(sigma, 2.0))) * cos(2 * M_PI * xx / T);
-
-      if (kernel[row][col] > 0) {positive_sum += kernel[row][col];}
-      else  {negative_sum += (-kernel[row][col]);}
-
-      cout << setprecision(2) << kernel[row][col] << " ";
-    }
-    cout << endl;
-  }
-
-  double scale = (positive_sum > negative_sum) ? positive_sum : negative_sum;
-  cout << "Scale Factor: " << scale << endl;
-  for (int row = 0; row < kernel_size; row++)
-  {
-    for (int col = 0; col < kernel_size; col++)
-    {
-      kernel[row][col] = kernel[row][col] / scale;
-    }
-  }
-}
+  KernelType type;
+  double theta, sigma, period;  // Gabor filter, sigma also of the box Gaussian
+  int radius;   // box filter
+  string filterfile;
+};
 
 
 /*
 get the image pixmap
+  return false if the image cannot be read
 */
-void readimage(string infilename)
+bool readimage(string infilename)
 {
   // read the input image and store as a pixmap
   ImageInput *in = ImageInput::open(infilename);
   if (!in)
   {
     cerr << "Cannot get the input image for " << infilename << ", error = " << geterror() << endl;
-    exit(0);
+    return false;
   }
   else
   {
@@ -262,41 +111,95 @@ void readimage(string infilename)
     cout << "channels: " << inputChannels << endl;
 
     inputpixmap = new unsigned char [xres * yres * inputChannels];
-    in -> read_image(TypeDesc::UINT8, inputpixmap);
+    bool read = in -> read_image(TypeDesc::UINT8, inputpixmap);
+    if (!read)  {cerr << "Cannot read the input image " << infilename << ", error = " << in -> geterror() << endl;}
 
     in -> close();  // close the file
     delete in;    // free ImageInput
+    return read;
   }
 }
 
 
 /*
 write out the associated color image from image pixel map
+  return false if the file cannot be created or written
 */
-void writeimage(string outfilename, int channels)
+bool writeimage(string outfilename, int channels)
 {   
   // create the subclass instance of ImageOutput which can write the right kind of file format
   ImageOutput *out = ImageOutput::create(outfilename);
   if (!out)
   {
     cerr << "Could not create output image for " << outfilename << ", error = " << geterror() << endl;
+    return false;
   }
   else
   {   
-    // open and prepare the image file
+    // open and prepare the image file, then write the entire image
     ImageSpec spec (xres, yres, channels, TypeDesc::UINT8);
-    out -> open(outfilename, spec);
-    // write the entire image
-    out -> write_image(TypeDesc::UINT8, outputpixmap);
-    cout << "Write the image pixmap to image file " << outfilename << endl;
+    bool written = out -> open(outfilename, spec) and out -> write_image(TypeDesc::UINT8, outputpixmap);
     // close the file and free the ImageOutput I created
-    out -> close();
+    if (!out -> close())  {written = false;}
+    if (written)  {cout << "Write the image pixmap to image file " << outfilename << endl;}
+    else  {cerr << "Could not write output image " << outfilename << ", error = " << out -> geterror() << endl;}
+
+    delete out;
+    return written;
+  }
+}
+
+
+/*
+filter an image file into an output image file one scanline at a time, the images are never held in memory
+  the input scanlines are read as the convolution needs them and every filtered row is written right away
+  return false if the input cannot be read or the output cannot be written
+*/
+bool streamimage(string infilename, string outfilename, ThreadPool &pool)
+{
+  ImageInput *in = ImageInput::open(infilename);
+  if (!in)
+  {
+    cerr << "Cannot get the input image for " << infilename << ", error = " << geterror() << endl;
+    return false;
+  }
+  const ImageSpec &spec = in -> spec();
+  xres = spec.width;
+  yres = spec.height;
+  inputChannels = spec.nchannels;
+  cout << "Image Size: " << xres << "X" << yres << endl;
+  cout << "channels: " << inputChannels << endl;
 
+  ImageOutput *out = ImageOutput::create(outfilename);
+  ImageSpec outspec (xres, yres, inputChannels, TypeDesc::UINT8);
+  if (!out or !out -> open(outfilename, outspec))
+  {
+    cerr << "Could not create output image for " << outfilename << ", error = " << (out ? out -> geterror() : geterror()) << endl;
     delete out;
+    in -> close();
+    delete in;
+    return false;
   }
+
+  // a failed read or write is reported once the image is done, the stream still runs to the end
+  bool read = true, written = true;
+  filterStream([&](int y, unsigned char *pixels)  {if (!in -> read_scanlines(y, y + 1, 0, TypeDesc::UINT8, pixels)) {read = false;}},
+               [&](int y0, int y1, const unsigned char *pixels)  {if (!out -> write_scanlines(y0, y1, 0, TypeDesc::UINT8, pixels)) {written = false;}},
+               pool);
+
+  // close the files
+  in -> close();
+  if (!out -> close())  {written = false;}
+  if (!read)  {cerr << "Cannot read the input image " << infilename << ", error = " << in -> geterror() << endl;}
+  else if (!written)  {cerr << "Could not write output image " << outfilename << ", error = " << out -> geterror() << endl;}
+  else  {cout << "Write the filtered scanlines to image file " << outfilename << endl;}
+  delete in;
+  delete out;
+  return read and written;
 }
 
 
+# ifndef FILT_NO_GL
 /*
 display composed associated color image
 */
@@ -373,6 +276,262 @@ void handleReshape(int w, int h)
   gluOrtho2D(0, w, 0, h);
   glMatrixMode(GL_MODELVIEW);
 }
+# endif
+
+
+/*
+parse the kernel of a filter bank or pipeline line whose first word is first:
+  g <theta> <sigma> <period>    Gabor filter
+  box <radius>                  box filter
+  gauss <sigma>                 Gaussian approximated by iterated box filters
+  <filter_file>                 filter file
+*/
+BankEntry parseKernel(const string &first, istringstream &fields, const string &file, const string &line)
+{
+  BankEntry entry;
+  if (first == "g")
+  {
+    entry.type = KERNEL_GABOR;
+    if (!(fields >> entry.theta >> entry.sigma >> entry.period))  {cerr << "Bad Gabor filter in " << file << ": " << line << endl;  exit(0);}
+  }
+  else if (first == "box")
+  {
+    entry.type = KERNEL_BOX;
+    if (!(fields >> entry.radius) or entry.radius < 0)  {cerr << "Bad box filter in " << file << ": " << line << endl;  exit(0);}
+  }
+  else if (first == "gauss")
+  {
+    entry.type = KERNEL_BOX_GAUSSIAN;
+    if (!(fields >> entry.sigma) or entry.sigma <= 0)  {cerr << "Bad box Gaussian in " << file << ": " << line << endl;  exit(0);}
+  }
+  else  {entry.type = KERNEL_FILE;  entry.filterfile = first;}
+  return entry;
+}
+
+
+/*
+read a filter bank file, one kernel per line as in parseKernel()
+empty lines and lines starting with # are skipped
+*/
+vector<BankEntry> readBank(string bankfile)
+{
+  vector<BankEntry> bank;
+  fstream bankFile(bankfile.c_str());
+  if (!bankFile)  {cerr << "Cannot open the filter bank file " << bankfile << endl;  exit(0);}
+  string line;
+  while (getline(bankFile, line))
+  {
+    istringstream fields(line);
+    string first;
+    if (!(fields >> first) or first[0] == '#')  {continue;}
+    bank.push_back(parseKernel(first, fields, bankfile, line));
+  }
+  return bank;
+}
+
+
+/*
+largest kernel radius in the filter bank, used as the shared reflected border of the FFT path
+*/
+int bankPad(const vector<BankEntry> &bank)
+{
+  int pad = 0;
+  for (size_t i = 0; i < bank.size(); i++)
+  {
+    int size;
+    if (bank[i].type == KERNEL_GABOR) {size = 4 * bank[i].sigma + 1;}
+    else if (bank[i].type == KERNEL_BOX)  {size = 2 * bank[i].radius + 1;}
+    else if (bank[i].type == KERNEL_BOX_GAUSSIAN)
+    {
+      vector<int> radii = boxGaussianRadii(bank[i].sigma);
+      size = 1;
+      for (size_t p = 0; p < radii.size(); p++) {size += 2 * radii[p];}
+    }
+    else
+    {
+      fstream filterFile(bank[i].filterfile.c_str());
+      if (!(filterFile >> size))  {cerr << "Cannot read the filter file " << bank[i].filterfile << endl;  exit(0);}
+    }
+    pad = max(pad, (size - 1) / 2);
+  }
+  return pad;
+}
+
+
+/*
+output file name of the i-th kernel of a filter bank: name.png -> name_<i>.png
+*/
+string bankOutputName(string outImage, int i)
+{
+  ostringstream name;
+  size_t dot = outImage.find_last_of('.');
+  size_t slash = outImage.find_last_of('/');
+  if (dot == string::npos or (slash != string::npos and dot < slash))  {dot = outImage.size();}
+  name << outImage.substr(0, dot) << "_" << i << outImage.substr(dot);
+  return name.str();
+}
+
+
+/*
+load and factor the kernel of a filter bank entry
+  with a kernel cache, filter files and Gabor filters come from the cache when they are in it,
+  otherwise they are stored in it once factored
+*/
+void loadKernel(const BankEntry &entry)
+{
+  string key;
+  if (cache_dir != "" and entry.type == KERNEL_FILE)  {key = fileKernelKey(entry.filterfile);}
+  if (cache_dir != "" and entry.type == KERNEL_GABOR) {key = gaborKernelKey(entry.theta, entry.sigma, entry.period);}
+  if (loadCachedKernel(key))  {return;}
+
+  if (entry.type == KERNEL_GABOR)
+  {
+    cout << "Gabor Filter: theta = " << entry.theta << " sigma = " << entry.sigma << " period = " << entry.period << endl;
+    getGaborFilter(entry.theta, entry.sigma, entry.period);
+  }
+  else if (entry.type == KERNEL_BOX) {getBoxFilter(entry.radius);}
+  else if (entry.type == KERNEL_BOX_GAUSSIAN) {getBoxGaussian(entry.sigma);}
+  else  {readfilter(entry.filterfile);}
+  factorKernel();
+  saveCachedKernel(key);
+}
+
+
+/*
+run every kernel of the filter bank over the shared channel planes, one output file per kernel
+  return false if an output file cannot be written
+*/
+bool filterBank(const vector<BankEntry> &bank, string outImage, ThreadPool &pool)
+{
+  bool written = true;
+  plane_border = bankPad(bank);
+  for (size_t i = 0; i < bank.size(); i++)
+  {
+    loadKernel(bank[i]);
+    filterImage(pool);
+    if (!writeimage(bankOutputName(outImage, i), inputChannels))  {written = false;}
+    releaseKernel();
+    delete [] outputpixmap;
+    outputpixmap = NULL;
+  }
+  return written;
+}
+
+
+/*
+read a pipeline file, one stage per line, applied from the first line to the last:
+  a kernel as in parseKernel()
+  abs                   absolute value
+  scale <a> [<b>]       a * value + b
+  threshold <t>         1 if value >= t, 0 otherwise
+  clamp                 clamp to 0-1
+empty lines and lines starting with # are skipped. The kernels are loaded and factored once.
+*/
+vector<PipelineStage> readPipeline(string pipelinefile)
+{
+  vector<PipelineStage> stages;
+  fstream pipelineFile(pipelinefile.c_str());
+  if (!pipelineFile)  {cerr << "Cannot open the pipeline file " << pipelinefile << endl;  exit(0);}
+  string line;
+  while (getline(pipelineFile, line))
+  {
+    istringstream fields(line);
+    string first;
+    if (!(fields >> first) or first[0] == '#')  {continue;}
+    double a = 0, b = 0;
+    if (first == "abs") {stages.push_back(pointStage(STAGE_ABS));}
+    else if (first == "clamp")  {stages.push_back(pointStage(STAGE_CLAMP));}
+    else if (first == "scale")
+    {
+      if (!(fields >> a))  {cerr << "Bad scale in " << pipelinefile << ": " << line << endl;  exit(0);}
+      fields >> b;
+      stages.push_back(pointStage(STAGE_SCALE, a, b));
+    }
+    else if (first == "threshold")
+    {
+      if (!(fields >> a))  {cerr << "Bad threshold in " << pipelinefile << ": " << line << endl;  exit(0);}
+      stages.push_back(pointStage(STAGE_THRESHOLD, a));
+    }
+    else
+    {
+      loadKernel(parseKernel(first, fields, pipelinefile, line));
+      stages.push_back(kernelStage());
+      releaseKernel();
+    }
+  }
+  if (stages.empty()) {cerr << "No stages in the pipeline file " << pipelinefile << endl;  exit(0);}
+  return stages;
+}
+
+
+/*
+read a batch list file, one "<input_image> <output_image>" pair per line
+empty lines and lines starting with # are skipped
+*/
+vector<pair<string, string> > readBatch(string batchfile)
+{
+  vector<pair<string, string> > jobs;
+  fstream batchFile(batchfile.c_str());
+  if (!batchFile) {cerr << "Cannot open the batch file " << batchfile << endl;  exit(0);}
+  string line;
+  while (getline(batchFile, line))
+  {
+    istringstream fields(line);
+    string input, output;
+    if (!(fields >> input) or input[0] == '#')  {continue;}
+    if (!(fields >> output))  {cerr << "Missing output image in " << batchfile << ": " << line << endl;  exit(0);}
+    jobs.push_back(make_pair(input, output));
+  }
+  return jobs;
+}
+
+
+/*
+filter every image of a batch list, nothing is displayed
+  with a single kernel the kernel is loaded once for all images,
+  with a filter bank output i of each image goes to <output_image>_<i>
+  with stream every image is filtered scanline by scanline, with a pipeline every image runs through all its stages
+  an image that cannot be read or written is reported and skipped, return the number of such images
+*/
+int filterBatch(const vector<pair<string, string> > &jobs, const vector<BankEntry> &kernels, bool bank, bool stream, const vector<PipelineStage> &pipeline, ThreadPool &pool)
+{
+  if (!bank and pipeline.empty())
+  {
+    loadKernel(kernels[0]);
+    plane_border = (kernel_size - 1) / 2;
+  }
+  int failed = 0;
+  for (size_t i = 0; i < jobs.size(); i++)
+  {
+    cout << "Batch " << i + 1 << "/" << jobs.size() << ": " << jobs[i].first << " -> " << jobs[i].second << endl;
+    bool written;
+    if (stream)  {written = streamimage(jobs[i].first, jobs[i].second, pool);}
+    else if (!readimage(jobs[i].first))  {written = false;}
+    else
+    {
+      if (bank) {written = filterBank(kernels, jobs[i].second, pool);}
+      else
+      {
+        if (!pipeline.empty())  {runPipeline(pipeline, pool);}
+        else  {filterImage(pool);}
+        written = writeimage(jobs[i].second, inputChannels);
+        delete [] outputpixmap;
+        outputpixmap = NULL;
+      }
+      releaseChannels();
+    }
+    delete [] inputpixmap;
+    inputpixmap = NULL;
+    if (!written)
+    {
+      cout << "Batch " << i + 1 << "/" << jobs.size() << ": " << jobs[i].second << " not written" << endl;
+      failed++;
+    }
+  }
+  if (!bank)  {releaseKernel();}
+  if (failed > 0)  {cout << "Batch complete, images not written: " << failed << endl;}
+  return failed;
+}
 
 
 /*
@@ -381,6 +540,33 @@ command line option parser
   MODE2 - filter the image via filter from file: filt <input_image_name> <filter_name> <output_image_name>(optional)
 */
 char **getIter(char** begin, char** end, const std::string& option) {return find(begin, end, option);}
+/*
+take an option with one value out of the argument list, so the positional arguments keep their places
+  return the option value, or an empty string if the option is not given
+*/
+string takeOption(int &argc, char **argv, const string &option)
+{
+  char **iter = getIter(argv, argv + argc, option);
+  if (iter == argv + argc)  {return "";}
+  if (iter + 1 == argv + argc)  {cout << "Missing value for option " << option << endl; exit(0);}
+  string value = iter[1];
+  for (char **p = iter; p + 2 < argv + argc; p++)  {p[0] = p[2];}
+  argc -= 2;
+  argv[argc] = NULL;
+  return value;
+}
+/*
+take an option without a value out of the argument list, return whether it was given
+*/
+bool takeFlag(int &argc, char **argv, const string &option)
+{
+  char **iter = getIter(argv, argv + argc, option);
+  if (iter == argv + argc)  {return false;}
+  for (char **p = iter; p + 1 < argv + argc; p++)  {p[0] = p[1];}
+  argc -= 1;
+  argv[argc] = NULL;
+  return true;
+}
 void getCmdOption(int argc, char **argv, string &inputImage, string &filter, string &outImage, double &theta, double &sigma, double &T, int &mode)
 {
   if (argc < 3)
@@ -390,6 +576,18 @@ void getCmdOption(int argc, char **argv, string &inputImage, string &filter, str
     cout << "[Usage] filt <input_image_name> <output_image_name>(optional) -g theta sigma period" << endl;
     cout << "Filter File: " << endl;
     cout << "[Usage] filt <input_image_name> <filter_name> <output_image_name>(optional)" << endl;
+    cout << "Box Filter and Iterated Box Gaussian: " << endl;
+    cout << "[Usage] filt <input_image_name> <output_image_name>(optional) -box radius | -gauss sigma" << endl;
+    cout << "Pipeline: " << endl;
+    cout << "[Usage] filt <input_image_name> <output_image_name>(optional) -pipeline <pipeline_file>" << endl;
+    cout << "Options: " << endl;
+    cout << "  -j threads   number of threads used to filter the image, default: all cores" << endl;
+    cout << "  -conv auto|direct|fft   convolution method, default: auto" << endl;
+    cout << "  -p double|float|int16   arithmetic of direct convolution, default: double" << endl;
+    cout << "  -stream   filter scanline by scanline into the output image without holding the images, nothing is displayed" << endl;
+    cout << "  -cache dir   keep prepared kernels and their FFT spectra in a cache directory" << endl;
+    cout << "Filter Bank: " << endl;
+    cout << "[Usage] filt <input_image_name> <output_image_name> -bank <bank_file>" << endl;
     exit(0);
   }
   char **iter = getIter(argv, argv + argc, "-g");
@@ -443,30 +641,140 @@ int main(int argc, char* argv[])
   string inputImage;    // input image file name
   string filter;    // filter file name
   string outImage;  // output image file name
-  double theta;   // gabor filter parameter: theta
-  double sigma;   // gabor filter parameter: sigma
-  double T;       // gabor filter parameter: period
-  int mode = 0; // mode = 1: gabor filter, mode = 2: filter from file
+  double theta = 0;   // gabor filter parameter: theta
+  double sigma = 0;   // gabor filter parameter: sigma
+  double T = 0;       // gabor filter parameter: period
+  int mode = 0; // mode = 1: gabor filter, mode = 2: filter from file, mode = 3: box filter, mode = 4: box Gaussian, mode = 5: pipeline
 
   // command line parser
-  getCmdOption(argc, argv, inputImage, filter, outImage, theta, sigma, T, mode);
+  string threads = takeOption(argc, argv, "-j");
+  nthreads = (threads != "") ? atoi(threads.c_str()) : thread::hardware_concurrency();
+  string method = takeOption(argc, argv, "-conv");
+  if (method == "direct") {conv_method = CONV_DIRECT;}
+  else if (method == "fft") {conv_method = CONV_FFT;}
+  else if (method != "" and method != "auto") {cout << "Unknown convolution method " << method << endl;  exit(0);}
+  string arithmetic = takeOption(argc, argv, "-p");
+  if (arithmetic == "float")  {precision = PRECISION_FLOAT;}
+  else if (arithmetic == "int16") {precision = PRECISION_INT16;}
+  else if (arithmetic != "" and arithmetic != "double")  {cout << "Unknown precision " << arithmetic << endl;  exit(0);}
+  string bankfile = takeOption(argc, argv, "-bank");
+  string box = takeOption(argc, argv, "-box");
+  string gauss = takeOption(argc, argv, "-gauss");
+  bool stream = takeFlag(argc, argv, "-stream");
+  cache_dir = takeOption(argc, argv, "-cache");
+  string pipelinefile = takeOption(argc, argv, "-pipeline");
+  if (stream and bankfile != "")  {cout << "-stream filters with a single kernel, not a filter bank" << endl;  exit(0);}
+  if (stream and pipelinefile != "")  {cout << "-stream filters with a single kernel, not a pipeline" << endl;  exit(0);}
+  string batchfile = takeOption(argc, argv, "--batch");
+  // batch mode: the remaining arguments only name the kernel
+  if (batchfile != "")
+  {
+    vector<BankEntry> kernels;
+    vector<PipelineStage> pipeline;
+    if (bankfile != "") {kernels = readBank(bankfile);}
+    else if (pipelinefile != "")  {pipeline = readPipeline(pipelinefile);}
+    else
+    {
+      BankEntry entry;
+      if (box != "" and argc == 1)  {entry.type = KERNEL_BOX;  entry.radius = atoi(box.c_str());}
+      else if (gauss != "" and argc == 1) {entry.type = KERNEL_BOX_GAUSSIAN;  entry.sigma = atof(gauss.c_str());}
+      else if (argc == 5 and string(argv[1]) == "-g")
+      {
+        entry.type = KERNEL_GABOR;
+        entry.theta = atof(argv[2]);  entry.sigma = atof(argv[3]);  entry.period = atof(argv[4]);
+      }
+      else if (argc == 2) {entry.type = KERNEL_FILE;  entry.filterfile = argv[1];}
+      else
+      {
+        cout << "Batch: " << endl << "[Usage] filt --batch <batch_file> <filter_name> | -g theta sigma period | -box radius | -gauss sigma | -bank <bank_file> | -pipeline <pipeline_file>" << endl;
+        exit(0);
+      }
+      kernels.push_back(entry);
+    }
+    ThreadPool pool(nthreads);
+    int failed = filterBatch(readBatch(batchfile), kernels, bankfile != "", stream, pipeline, pool);
+    return (failed > 0) ? 1 : 0;
+  }
+  if (bankfile != "")
+  {
+    if (argc != 3)  {cout << "Filter Bank: " << endl << "[Usage] filt <input_image_name> <output_image_name> -bank <bank_file>" << endl;  exit(0);}
+    inputImage = argv[1];
+    outImage = argv[2];
+    cout << "Filter Bank: " << bankfile << endl;
+  }
+  else if (pipelinefile != "")
+  {
+    if (argc < 2 or argc > 3)
+    {
+      cout << "Pipeline: " << endl << "[Usage] filt <input_image_name> <output_image_name>(optional) -pipeline <pipeline_file>" << endl;
+      exit(0);
+    }
+    mode = 5;
+    inputImage = argv[1];
+    if (argc == 3)  {outImage = argv[2];}
+  }
+  else if (box != "" or gauss != "")
+  {
+    if (argc < 2 or argc > 3)
+    {
+      cout << "Box Filter: " << endl << "[Usage] filt <input_image_name> <output_image_name>(optional) -box radius | -gauss sigma" << endl;
+      exit(0);
+    }
+    mode = (box != "") ? 3 : 4;
+    inputImage = argv[1];
+    if (argc == 3)  {outImage = argv[2];}
+  }
+  else  {getCmdOption(argc, argv, inputImage, filter, outImage, theta, sigma, T, mode);}
+
+  // the kernel of the single image modes
+  BankEntry entry;
+  entry.type = (mode == 1) ? KERNEL_GABOR : (mode == 3) ? KERNEL_BOX : (mode == 4) ? KERNEL_BOX_GAUSSIAN : KERNEL_FILE;
+  entry.theta = theta;  entry.sigma = (mode == 4) ? atof(gauss.c_str()) : sigma;  entry.period = T;
+  entry.radius = atoi(box.c_str());
+  entry.filterfile = filter;
+
+  // streaming: the output goes straight to the output file, nothing is displayed
+  if (stream)
+  {
+    if (outImage == "")  {cout << "-stream needs an output image" << endl;  exit(0);}
+    loadKernel(entry);
+    ThreadPool pool(nthreads);
+    streamimage(inputImage, outImage, pool);
+    releaseKernel();
+    return 0;
+  }
   
   // read input image
-  readimage(inputImage);
-  // filter image
-  if (mode == 1)
+  if (!readimage(inputImage))  {exit(0);}
+  ThreadPool pool(nthreads);
+  // filter bank: write one output per kernel and quit
+  if (bankfile != "")
   {
-    getGaborFilter(theta, sigma, T);    
-    filterImage();
+    filterBank(readBank(bankfile), outImage, pool);
+    releaseChannels();
+    delete [] inputpixmap;
+    return 0;
   }
-  if (mode == 2)
+  // filter image
+  if (mode == 5)  {runPipeline(readPipeline(pipelinefile), pool);}
+  else
   {
-    readfilter(filter);
-    filterImage();
+    loadKernel(entry);
+    plane_border = (kernel_size - 1) / 2;
+    filterImage(pool);
   }
+  releaseChannels();
   // write out to an output image file
   if (outImage != "") {writeimage(outImage, inputChannels);}
   
+# ifdef FILT_NO_GL
+  // headless build: nothing to display
+  delete [] inputpixmap;
+  delete [] outputpixmap;
+  releaseKernel();
+
+  return 0;
+# else
   // display input image and output image in seperated windows
   // start up the glut utilities
   glutInit(&argc, argv);
@@ -496,9 +804,9 @@ int main(int argc, char* argv[])
   // release memory
   delete [] inputpixmap;
   delete [] outputpixmap;
-  for (int i = 0; i < kernel_size; i++)  {delete [] kernel[i];}
-  delete [] kernel;
+  releaseKernel();
 
   return 0;
+# endif
 }
 
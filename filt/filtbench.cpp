@@ -0,0 +1,394 @@
+/*
+Benchmark of the filt convolution engines over synthetic images, the bundled filter files and a sweep of Gabor sigmas.
+Every measurement runs in its own child process, so the reported peak RSS belongs to that engine, image and kernel only.
+
+Usage:
+  filtbench [options]
+- Options
+  -sizes <n,n,...>  square image sizes, default: 256,512,1024,2048,4096,8192
+  -filters <dir>  directory of the .filt files, default: filters
+  -sigmas <s,s,...>  Gabor sigmas, theta 30 and period 4 * sigma, default: 1,2,4,8,16
+  -engines <e,e,...>  direct,separable,fft,threaded,simd-float,simd-int16,box (default: all)
+  -boxes <r,r,...>  box filter radii, default: 1,4,16,64
+  -j <threads>  threads of the threaded engine, default: all cores
+  -reps <n>  filter each image n times and keep the fastest, default: 3
+  -budget <taps>  skip measurements estimated above this many multiply-adds, default: 2e10
+  -format <csv|json>  output format, default: csv
+  -o <file>  output file, default: standard output
+
+Jingcong Zhang
+jingcoz@g.clemson.edu
+*/
+
+# include <stdlib.h>
+# include <cstdlib>
+# include <iostream>
+# include <fstream>
+# include <sstream>
+# include <string>
+# include <vector>
+# include <algorithm>
+# include <chrono>
+# include <thread>
+# include <math.h>
+# include <dirent.h>
+# include <unistd.h>
+# include <sys/wait.h>
+# include <sys/resource.h>
+
+# include "threadpool.h"
+# include "convolve.h"
+# include "fft.h"
+
+using namespace std;
+
+
+static const int CHANNELS = 3;  // synthetic images are RGB
+
+// a kernel of the benchmark: a filter file or a Gabor filter
+struct BenchKernel
+{
+  string name;
+  string filterfile;
+  double sigma;
+  int radius;  // box filter, -1 otherwise
+  int size;
+  int rank;
+  bool box;   // runs on summed-area tables
+};
+
+// one line of the report
+struct BenchResult
+{
+  string engine;
+  int size;
+  string kernel;
+  int kernel_size;
+  int rank;
+  int threads;
+  double seconds;
+  double mpix_per_s;
+  double ns_per_tap;
+  long peak_rss_kb;
+  string status;  // ok, over budget, not separable, not box or failed
+};
+
+
+/*
+split a comma separated list
+*/
+vector<string> splitList(const string &list)
+{
+  vector<string> items;
+  stringstream fields(list);
+  string item;
+  while (getline(fields, item, ','))  {if (item != "") {items.push_back(item);}}
+  return items;
+}
+
+
+/*
+fill the input pixmap with a deterministic synthetic image: gradients, a checkerboard and pseudo-random noise
+*/
+void makeImage(int size)
+{
+  xres = yres = size;
+  inputChannels = CHANNELS;
+  inputpixmap = new unsigned char [size * size * CHANNELS];
+  unsigned int seed = 12345;
+  for (int row = 0; row < size; row++)
+  {
+    for (int col = 0; col < size; col++)
+    {
+      unsigned char *pixel = inputpixmap + (row * size + col) * CHANNELS;
+      seed = seed * 1103515245 + 12345;
+      int noise = (seed >> 16) & 63;
+      int check = (((row >> 4) + (col >> 4)) & 1) ? 64 : 0;
+      pixel[0] = (col * 255 / size + noise) & 255;
+      pixel[1] = (row * 255 / size + check) & 255;
+      pixel[2] = (check + noise * 2) & 255;
+    }
+  }
+}
+
+
+/*
+load a benchmark kernel and factor it, the kernel messages are not printed
+*/
+void loadKernel(const BenchKernel &k)
+{
+  streambuf *saved = cout.rdbuf(NULL);
+  streamsize digits = cout.precision();
+  if (k.filterfile != "") {readfilter(k.filterfile);}
+  else if (k.radius >= 0) {getBoxFilter(k.radius);}
+  else  {getGaborFilter(30, k.sigma, 4 * k.sigma);}
+  factorKernel();
+  cout.rdbuf(saved);
+  cout.precision(digits);
+}
+
+
+/*
+list the bundled filter files and the Gabor sweep, with their sizes and separable ranks
+*/
+vector<BenchKernel> benchKernels(const string &dir, const vector<string> &sigmas, const vector<string> &boxes)
+{
+  vector<BenchKernel> kernels;
+  vector<string> files;
+  DIR *d = opendir(dir.c_str());
+  if (!d) {cerr << "Cannot open the filter directory " << dir << endl;  exit(0);}
+  for (struct dirent *entry = readdir(d); entry; entry = readdir(d))
+  {
+    string name = entry->d_name;
+    if (name.size() > 5 and name.substr(name.size() - 5) == ".filt")  {files.push_back(name);}
+  }
+  closedir(d);
+  sort(files.begin(), files.end());
+  for (size_t i = 0; i < files.size(); i++)
+  {
+    BenchKernel k;
+    k.name = files[i].substr(0, files[i].size() - 5);
+    k.filterfile = dir + "/" + files[i];
+    k.sigma = 0;
+    k.radius = -1;
+    kernels.push_back(k);
+  }
+  for (size_t i = 0; i < sigmas.size(); i++)
+  {
+    BenchKernel k;
+    k.name = "gabor-s" + sigmas[i];
+    k.sigma = atof(sigmas[i].c_str());
+    k.radius = -1;
+    kernels.push_back(k);
+  }
+  for (size_t i = 0; i < boxes.size(); i++)
+  {
+    BenchKernel k;
+    k.name = "box-r" + boxes[i];
+    k.sigma = 0;
+    k.radius = atoi(boxes[i].c_str());
+    kernels.push_back(k);
+  }
+  for (size_t i = 0; i < kernels.size(); i++)
+  {
+    loadKernel(kernels[i]);
+    kernels[i].size = kernel_size;
+    kernels[i].rank = kernel_rank;
+    kernels[i].box = !box_radii.empty();
+    releaseKernel();
+  }
+  return kernels;
+}
+
+
+/*
+estimated multiply-adds of one engine on one image, used to skip measurements that would run too long
+*/
+double estimateTaps(const string &engine, int size, const BenchKernel &k)
+{
+  double pixels = double(size) * size * CHANNELS;
+  if (engine == "fft")
+  {
+    int pad = (k.size - 1) / 2;
+    double n = double(nextPowerOfTwo(size + 2 * pad)) * nextPowerOfTwo(size + 2 * pad);
+    // forward and inverse transforms of each channel pair plus the kernel spectrum
+    return 5 * n * log2(n) * ((CHANNELS + 1) / 2 * 2 + 1);
+  }
+  // a box filter reads four table entries per pixel and builds the table once
+  if (engine == "box")  {return pixels * 8;}
+  if (engine == "simd-int16" or k.rank == 0 or engine == "direct")  {return pixels * k.size * k.size;}
+  return pixels * 2 * k.rank * k.size;
+}
+
+
+/*
+set up the filter globals for an engine, return the number of threads it runs on
+  the separable engine always runs the separable passes, also at the sizes where filt prefers the unrolled 2D kernel
+*/
+int selectEngine(const string &engine, int threads)
+{
+  conv_method = CONV_DIRECT;
+  precision = PRECISION_DOUBLE;
+  use_separable = true;
+  use_fixed_kernels = (engine != "separable");
+  if (engine == "direct") {use_separable = false;}
+  else if (engine == "fft") {conv_method = CONV_FFT;}
+  else if (engine == "simd-float")  {precision = PRECISION_FLOAT;}
+  else if (engine == "simd-int16")  {precision = PRECISION_INT16;}
+  else if (engine == "box")  {conv_method = CONV_AUTO;}
+  else if (engine == "threaded")  {return threads;}
+  else if (engine != "separable") {cerr << "Unknown engine " << engine << endl;  exit(0);}
+  return 1;
+}
+
+
+/*
+filter the image reps times in a child process with the engine of the last selectEngine() and return the fastest time in seconds
+  the peak RSS of the child is returned in peak_rss_kb, a negative time means the child failed
+*/
+double measure(int size, const BenchKernel &k, int threads, int reps, long &peak_rss_kb)
+{
+  int fds[2];
+  if (pipe(fds) != 0) {cerr << "Cannot create a pipe" << endl;  exit(0);}
+  cout.flush();
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    // child: build the image and kernel, run the engine, send the time back
+    close(fds[0]);
+    cout.rdbuf(NULL);
+    makeImage(size);
+    loadKernel(k);
+    plane_border = (kernel_size - 1) / 2;
+    ThreadPool pool(threads);
+    double best = -1;
+    for (int r = 0; r < reps; r++)
+    {
+      // every repetition starts from the image, so the channel planes and input spectra are part of the time
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      filterImage(pool);
+      double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+      if (best < 0 or seconds < best) {best = seconds;}
+      delete [] outputpixmap;
+      releaseChannels();
+    }
+    ssize_t written = write(fds[1], &best, sizeof(best));
+    _exit(written == sizeof(best) ? 0 : 1);
+  }
+  close(fds[1]);
+  double seconds = -1;
+  if (read(fds[0], &seconds, sizeof(seconds)) != sizeof(seconds)) {seconds = -1;}
+  close(fds[0]);
+  int status;
+  struct rusage usage;
+  wait4(pid, &status, 0, &usage);
+  peak_rss_kb = usage.ru_maxrss;
+  if (!WIFEXITED(status) or WEXITSTATUS(status) != 0)  {seconds = -1;}
+  return seconds;
+}
+
+
+/*
+write the results as CSV or JSON
+*/
+void writeResults(ostream &out, const vector<BenchResult> &results, const string &format)
+{
+  if (format == "json")
+  {
+    out << "[" << endl;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+      const BenchResult &r = results[i];
+      out << "  {\"engine\": \"" << r.engine << "\", \"width\": " << r.size << ", \"height\": " << r.size
+          << ", \"channels\": " << CHANNELS << ", \"kernel\": \"" << r.kernel << "\", \"kernel_size\": " << r.kernel_size
+          << ", \"rank\": " << r.rank << ", \"threads\": " << r.threads << ", \"seconds\": " << r.seconds
+          << ", \"mpix_per_s\": " << r.mpix_per_s << ", \"ns_per_tap\": " << r.ns_per_tap
+          << ", \"peak_rss_kb\": " << r.peak_rss_kb << ", \"status\": \"" << r.status << "\"}"
+          << (i + 1 < results.size() ? "," : "") << endl;
+    }
+    out << "]" << endl;
+    return;
+  }
+  out << "engine,width,height,channels,kernel,kernel_size,rank,threads,seconds,mpix_per_s,ns_per_tap,peak_rss_kb,status" << endl;
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const BenchResult &r = results[i];
+    out << r.engine << "," << r.size << "," << r.size << "," << CHANNELS << "," << r.kernel << "," << r.kernel_size << ","
+        << r.rank << "," << r.threads << "," << r.seconds << "," << r.mpix_per_s << "," << r.ns_per_tap << ","
+        << r.peak_rss_kb << "," << r.status << endl;
+  }
+}
+
+
+/*
+Main program
+*/
+int main(int argc, char* argv[])
+{
+  string sizes = "256,512,1024,2048,4096,8192";
+  string filters = "filters";
+  string sigmas = "1,2,4,8,16";
+  string engines = "direct,separable,fft,threaded,simd-float,simd-int16,box";
+  string boxes = "1,4,16,64";
+  int threads = thread::hardware_concurrency();
+  int reps = 3;
+  double budget = 2e10;
+  string format = "csv";
+  string outfile;
+
+  // command line parser: every option takes one value
+  for (int i = 1; i < argc; i++)
+  {
+    string option = argv[i];
+    if (i + 1 == argc)  {cerr << "Missing value for option " << option << endl;  exit(0);}
+    string value = argv[++i];
+    if (option == "-sizes") {sizes = value;}
+    else if (option == "-filters")  {filters = value;}
+    else if (option == "-sigmas") {sigmas = value;}
+    else if (option == "-engines")  {engines = value;}
+    else if (option == "-boxes")  {boxes = value;}
+    else if (option == "-j")  {threads = atoi(value.c_str());}
+    else if (option == "-reps") {reps = max(1, atoi(value.c_str()));}
+    else if (option == "-budget") {budget = atof(value.c_str());}
+    else if (option == "-format") {format = value;}
+    else if (option == "-o")  {outfile = value;}
+    else  {cerr << "Unknown option " << option << endl;  exit(0);}
+  }
+  if (format != "csv" and format != "json") {cerr << "Unknown format " << format << endl;  exit(0);}
+  if (threads < 1)  {threads = 1;}
+
+  vector<string> size_list = splitList(sizes);
+  vector<string> engine_list = splitList(engines);
+  vector<BenchKernel> kernels = benchKernels(filters, splitList(sigmas), splitList(boxes));
+  for (size_t e = 0; e < engine_list.size(); e++) {selectEngine(engine_list[e], threads);}
+
+  vector<BenchResult> results;
+  for (size_t s = 0; s < size_list.size(); s++)
+  {
+    int size = atoi(size_list[s].c_str());
+    for (size_t k = 0; k < kernels.size(); k++)
+    {
+      for (size_t e = 0; e < engine_list.size(); e++)
+      {
+        BenchResult r;
+        r.engine = engine_list[e];
+        r.size = size;
+        r.kernel = kernels[k].name;
+        r.kernel_size = kernels[k].size;
+        r.rank = kernels[k].rank;
+        r.threads = selectEngine(r.engine, threads);
+        r.seconds = r.mpix_per_s = r.ns_per_tap = 0;
+        r.peak_rss_kb = 0;
+        if (r.engine == "separable" and kernels[k].rank == 0) {r.status = "not separable";}
+        else if (r.engine == "box" and !kernels[k].box) {r.status = "not box";}
+        else if (estimateTaps(r.engine, size, kernels[k]) > budget) {r.status = "over budget";}
+        else
+        {
+          r.seconds = measure(size, kernels[k], r.threads, reps, r.peak_rss_kb);
+          if (r.seconds < 0) {r.status = "failed";  r.seconds = 0;}
+          else
+          {
+            // ns per tap counts the taps of the full 2D kernel, so every engine is measured against the same work
+            double pixels = double(size) * size;
+            r.mpix_per_s = pixels / r.seconds / 1e6;
+            r.ns_per_tap = r.seconds * 1e9 / (pixels * CHANNELS * r.kernel_size * r.kernel_size);
+            r.status = "ok";
+          }
+        }
+        cerr << r.engine << " " << size << "X" << size << " " << r.kernel << ": " << r.status;
+        if (r.status == "ok") {cerr << " " << r.mpix_per_s << " MP/s";}
+        cerr << endl;
+        results.push_back(r);
+      }
+    }
+  }
+
+  if (outfile != "")
+  {
+    ofstream out(outfile.c_str());
+    if (!out) {cerr << "Cannot open the output file " << outfile << endl;  exit(0);}
+    writeResults(out, results, format);
+  }
+  else  {writeResults(cout, results, format);}
+  return 0;
+}
@@ -0,0 +1,218 @@
+/*
+On-disk kernel cache of filt.
+
+Files in the cache directory, native byte order (the cache is local to the machine):
+  <key>.kernel               "FILTKER1", int32 kernel_size, kernel_rank, box passes, int32 box radii,
+                             double box_gain, kernel_size^2 doubles of the normalized kernel,
+                             kernel_rank * kernel_size doubles of kernel_col, then of kernel_row
+  <key>_<pw>x<ph>.spectrum   "FILTSPC1", int32 pw, ph, pw * ph complex doubles
+Files are written under a temporary name and renamed, so concurrent jobs never read a partial file.
+A file that cannot be read is a cache miss, a file that cannot be written is skipped with a warning.
+
+Jingcong Zhang
+jingcoz@g.clemson.edu
+*/
+
+# include <iostream>
+# include <fstream>
+# include <sstream>
+# include <iomanip>
+# include <string>
+# include <vector>
+# include <stdint.h>
+# include <stdio.h>
+# include <unistd.h>
+# include <sys/stat.h>
+
+# include "kernelcache.h"
+# include "convolve.h"
+
+using namespace std;
+
+
+string cache_dir;
+string kernel_key;
+
+static const char KERNEL_MAGIC[] = "FILTKER1";
+static const char SPECTRUM_MAGIC[] = "FILTSPC1";
+
+
+/*
+64 bit FNV-1a hash of a byte string
+*/
+uint64_t hashBytes(const string &bytes)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < bytes.size(); i++)
+  {
+    hash ^= (unsigned char)bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+
+/*
+cache key: a letter for the kind of kernel and the hash of its description
+*/
+string makeKey(char kind, const string &description)
+{
+  ostringstream key;
+  key << kind << hex << setw(16) << setfill('0') << hashBytes(description);
+  return key.str();
+}
+
+
+/*
+key of a filter file: the hash of its content, an empty key if the file cannot be read
+*/
+string fileKernelKey(const string &filterfile)
+{
+  ifstream file(filterfile.c_str(), ios::binary);
+  if (!file)  {return "";}
+  ostringstream content;
+  content << file.rdbuf();
+  return makeKey('f', content.str());
+}
+
+
+/*
+key of a Gabor filter: the hash of its exact parameters
+*/
+string gaborKernelKey(double theta, double sigma, double T)
+{
+  ostringstream description;
+  description << setprecision(17) << theta << " " << sigma << " " << T;
+  return makeKey('g', description.str());
+}
+
+
+template <class T>
+void writeValues(ostream &out, const T *values, size_t count)  {out.write((const char *)values, count * sizeof(T));}
+
+template <class T>
+bool readValues(istream &in, T *values, size_t count)  {return bool(in.read((char *)values, count * sizeof(T)));}
+
+
+/*
+write a cache file: fill it under a temporary name, then rename it into place
+*/
+void writeCacheFile(const string &name, const string &content)
+{
+  mkdir(cache_dir.c_str(), 0755);
+  string path = cache_dir + "/" + name;
+  ostringstream temporary;
+  temporary << path << ".tmp" << getpid();
+  ofstream out(temporary.str().c_str(), ios::binary);
+  out.write(content.data(), content.size());
+  out.close();
+  if (!out or rename(temporary.str().c_str(), path.c_str()) != 0)
+  {
+    cerr << "Cannot write the kernel cache file " << path << endl;
+    remove(temporary.str().c_str());
+  }
+}
+
+
+/*
+load a cached kernel with its separable factors and box passes
+*/
+bool loadCachedKernel(const string &key)
+{
+  if (cache_dir == "" or key == "") {return false;}
+  ifstream in((cache_dir + "/" + key + ".kernel").c_str(), ios::binary);
+  char magic[8];
+  int32_t header[3];
+  if (!readValues(in, magic, 8) or string(magic, 8) != string(KERNEL_MAGIC, 8)) {return false;}
+  if (!readValues(in, header, 3) or header[0] < 1 or header[1] < 0 or header[2] < 0)  {return false;}
+  int size = header[0], rank = header[1], passes = header[2];
+  vector<int32_t> radii(passes);
+  double gain;
+  vector<double> values(size_t(size) * size + 2 * size_t(rank) * size);
+  if (passes > 0 and !readValues(in, &radii[0], passes))  {return false;}
+  if (!readValues(in, &gain, 1) or !readValues(in, &values[0], values.size())) {return false;}
+
+  kernel_size = size;
+  kernel_rank = rank;
+  const double *v = &values[0];
+  kernel = new double *[size];
+  for (int i = 0; i < size; i++, v += size)  {kernel[i] = new double [size];  copy(v, v + size, kernel[i]);}
+  if (rank > 0)
+  {
+    kernel_col = new double *[rank];
+    kernel_row = new double *[rank];
+    for (int k = 0; k < rank; k++, v += size)  {kernel_col[k] = new double [size];  copy(v, v + size, kernel_col[k]);}
+    for (int k = 0; k < rank; k++, v += size)  {kernel_row[k] = new double [size];  copy(v, v + size, kernel_row[k]);}
+  }
+  box_radii.assign(radii.begin(), radii.end());
+  box_gain = gain;
+  kernel_key = key;
+  cout << "Kernel Size: " << kernel_size << endl;
+  cout << "Cached Kernel: " << key << " rank " << kernel_rank << endl;
+  return true;
+}
+
+
+/*
+store the current kernel, its separable factors and box passes
+*/
+void saveCachedKernel(const string &key)
+{
+  if (cache_dir == "" or key == "") {return;}
+  ostringstream out;
+  int32_t header[3] = {kernel_size, kernel_rank, int32_t(box_radii.size())};
+  vector<int32_t> radii(box_radii.begin(), box_radii.end());
+  writeValues(out, KERNEL_MAGIC, 8);
+  writeValues(out, header, 3);
+  if (!radii.empty()) {writeValues(out, &radii[0], radii.size());}
+  writeValues(out, &box_gain, 1);
+  for (int i = 0; i < kernel_size; i++)  {writeValues(out, kernel[i], kernel_size);}
+  for (int k = 0; k < kernel_rank; k++)  {writeValues(out, kernel_col[k], kernel_size);}
+  for (int k = 0; k < kernel_rank; k++)  {writeValues(out, kernel_row[k], kernel_size);}
+  writeCacheFile(key + ".kernel", out.str());
+  kernel_key = key;
+}
+
+
+/*
+name of the spectrum file of the current kernel
+*/
+string spectrumName(int pw, int ph)
+{
+  ostringstream name;
+  name << kernel_key << "_" << pw << "x" << ph << ".spectrum";
+  return name.str();
+}
+
+
+/*
+load the cached spectrum of the current kernel
+*/
+Complex *loadCachedSpectrum(int pw, int ph)
+{
+  if (cache_dir == "" or kernel_key == "")  {return NULL;}
+  ifstream in((cache_dir + "/" + spectrumName(pw, ph)).c_str(), ios::binary);
+  char magic[8];
+  int32_t header[2];
+  if (!readValues(in, magic, 8) or string(magic, 8) != string(SPECTRUM_MAGIC, 8)) {return NULL;}
+  if (!readValues(in, header, 2) or header[0] != pw or header[1] != ph) {return NULL;}
+  Complex *spectrum = new Complex [pw * ph];
+  if (!readValues(in, (double *)spectrum, 2 * size_t(pw) * ph))  {delete [] spectrum;  return NULL;}
+  cout << "Cached Kernel Spectrum: " << pw << "X" << ph << endl;
+  return spectrum;
+}
+
+
+/*
+store the spectrum of the current kernel
+*/
+void saveCachedSpectrum(const Complex *spectrum, int pw, int ph)
+{
+  if (cache_dir == "" or kernel_key == "")  {return;}
+  ostringstream out;
+  int32_t header[2] = {pw, ph};
+  writeValues(out, SPECTRUM_MAGIC, 8);
+  writeValues(out, header, 2);
+  writeValues(out, (const double *)spectrum, 2 * size_t(pw) * ph);
+  writeCacheFile(spectrumName(pw, ph), out.str());
+}
@@ -0,0 +1,33 @@
+/*
+On-disk cache of prepared kernels for filt.
+A cached kernel keeps the normalized kernel, its separable factors and box passes,
+and the FFT spectra computed for it, so a repeated job skips parsing, normalization and factoring.
+Filter files are keyed by their content, Gabor filters by their parameters.
+
+Jingcong Zhang
+jingcoz@g.clemson.edu
+*/
+
+# ifndef KERNELCACHE_H
+# define KERNELCACHE_H
+
+# include <string>
+
+# include "fft.h"
+
+extern std::string cache_dir;   // directory of the cache files, empty if the cache is off
+extern std::string kernel_key;   // cache key of the current kernel, empty if it is not cached
+
+std::string fileKernelKey(const std::string &filterfile);
+std::string gaborKernelKey(double theta, double sigma, double T);
+
+// load the kernel of a key into the kernel globals, false if it is not in the cache
+bool loadCachedKernel(const std::string &key);
+// store the current, factored kernel under a key
+void saveCachedKernel(const std::string &key);
+
+// spectrum of the current kernel on a pw x ph plane, NULL if it is not in the cache
+Complex *loadCachedSpectrum(int pw, int ph);
+void saveCachedSpectrum(const Complex *spectrum, int pw, int ph);
+
+# endif
@@ -0,0 +1,264 @@
+/*
+Fused multi-pass filter pipeline of filt.
+
+Every output tile is computed on its own: the input tile is taken with a halo of the summed radii
+of all kernel stages, and each kernel stage shrinks the halo by its own radius.
+Buffer values outside the image are reflected from values inside the buffer after every kernel stage,
+which gives the same result as running the stages on whole images with reflected borders.
+
+Jingcong Zhang
+jingcoz@g.clemson.edu
+*/
+
+# include <iostream>
+# include <vector>
+# include <algorithm>
+# include <cmath>
+
+# include "pipeline.h"
+# include "convolve.h"
+# include "plane.h"
+
+using namespace std;
+
+
+const int PIPELINE_TILE = 128;  // output tile width and height in pixels, the stage buffers of a tile stay in the L2 cache
+
+// one channel of a region around a tile: rows row0 ... row0 + h - 1, columns col0 ... col0 + w - 1 in image coordinates
+struct TileBuffer
+{
+  int row0, col0, h, w;
+  vector<float> values;
+
+  void allocate(int r0, int c0, int rows, int cols)
+  {
+    row0 = r0;  col0 = c0;  h = rows;  w = cols;
+    values.resize(size_t(rows) * cols);
+  }
+  // value of column col0 of row y, column x is at row(y)[x - col0]
+  float *row(int y)  {return &values[size_t(y - row0) * w];}
+  const float *row(int y) const {return &values[size_t(y - row0) * w];}
+};
+
+
+/*
+pipeline stage of a point operation, or an empty stage of the given type
+*/
+PipelineStage pointStage(StageType type, double a, double b)
+{
+  PipelineStage stage;
+  stage.type = type;
+  stage.size = 1;
+  stage.rank = 0;
+  stage.a = a;
+  stage.b = b;
+  return stage;
+}
+
+
+/*
+pipeline stage of the current kernel: the flipped 2D kernel, and the flipped separable factors if it runs separable
+*/
+PipelineStage kernelStage()
+{
+  PipelineStage stage = pointStage(STAGE_KERNEL);
+  int k_n = kernel_size;
+  stage.size = k_n;
+  stage.rank = kernel_rank;
+  for (int i = 0; i < k_n; i++)
+  {
+    for (int j = 0; j < k_n; j++)  {stage.weights.push_back(kernel[k_n - 1 - i][k_n - 1 - j]);}
+  }
+  for (int k = 0; k < kernel_rank; k++)
+  {
+    for (int i = 0; i < k_n; i++)
+    {
+      stage.cols.push_back(kernel_col[k][k_n - 1 - i]);
+      stage.rows.push_back(kernel_row[k][k_n - 1 - i]);
+    }
+  }
+  return stage;
+}
+
+
+/*
+convolve a buffer with a kernel stage
+  out is allocated by the caller, in covers out and the kernel radius around it
+*/
+void applyKernel(const PipelineStage &stage, const TileBuffer &in, TileBuffer &out)
+{
+  int k_n = stage.size;
+  int r = (k_n - 1) / 2;
+  if (stage.rank == 0)
+  {
+    for (int y = out.row0; y < out.row0 + out.h; y++)
+    {
+      float *dst = out.row(y);
+      for (int x = 0; x < out.w; x++)
+      {
+        double sum = 0;
+        for (int i = 0; i < k_n; i++)
+        {
+          const float *src = in.row(y - r + i) + (out.col0 + x - r - in.col0);
+          const double *weights = &stage.weights[i * k_n];
+          for (int j = 0; j < k_n; j++)  {sum += weights[j] * src[j];}
+        }
+        dst[x] = sum;
+      }
+    }
+    return;
+  }
+
+  // separable: a horizontal pass over the output columns and the rows of the vertical halo, then a vertical pass
+  vector<double> tmp(size_t(out.h + 2 * r) * out.w);
+  vector<double> sum(size_t(out.h) * out.w, 0.0);
+  for (int k = 0; k < stage.rank; k++)
+  {
+    const double *row_weights = &stage.rows[k * k_n];
+    const double *col_weights = &stage.cols[k * k_n];
+    for (int y = 0; y < out.h + 2 * r; y++)
+    {
+      const float *src = in.row(out.row0 - r + y) + (out.col0 - r - in.col0);
+      for (int x = 0; x < out.w; x++)
+      {
+        double s = 0;
+        for (int j = 0; j < k_n; j++)  {s += row_weights[j] * src[x + j];}
+        tmp[y * out.w + x] = s;
+      }
+    }
+    for (int y = 0; y < out.h; y++)
+    {
+      for (int x = 0; x < out.w; x++)
+      {
+        double s = 0;
+        for (int i = 0; i < k_n; i++)  {s += col_weights[i] * tmp[(y + i) * out.w + x];}
+        sum[y * out.w + x] += s;
+      }
+    }
+  }
+  for (int y = 0; y < out.h; y++)
+  {
+    float *dst = out.row(out.row0 + y);
+    for (int x = 0; x < out.w; x++)  {dst[x] = sum[y * out.w + x];}
+  }
+}
+
+
+/*
+replace the buffer values outside the image by the reflected values inside it
+  the reflected positions always lie in the buffer, because it extends from the tile by the same margin on every side
+*/
+void reflectEdges(TileBuffer &buf)
+{
+  int row1 = buf.row0 + buf.h;
+  int col1 = buf.col0 + buf.w;
+  if (buf.row0 >= 0 and buf.col0 >= 0 and row1 <= yres and col1 <= xres)  {return;}
+  for (int y = max(buf.row0, 0); y < min(row1, yres); y++)
+  {
+    float *r = buf.row(y);
+    for (int x = buf.col0; x < 0; x++)  {r[x - buf.col0] = r[reflectIndex(x, xres) - buf.col0];}
+    for (int x = xres; x < col1; x++)  {r[x - buf.col0] = r[reflectIndex(x, xres) - buf.col0];}
+  }
+  for (int y = buf.row0; y < row1; y++)
+  {
+    if (y >= 0 and y < yres)  {continue;}
+    copy(buf.row(reflectIndex(y, yres)), buf.row(reflectIndex(y, yres)) + buf.w, buf.row(y));
+  }
+}
+
+
+/*
+apply a point operation to every value of a buffer
+*/
+void applyPoint(const PipelineStage &stage, TileBuffer &buf)
+{
+  for (size_t i = 0; i < buf.values.size(); i++)
+  {
+    float &v = buf.values[i];
+    switch (stage.type)
+    {
+      case STAGE_ABS:
+        v = fabs(v);
+        break;
+      case STAGE_SCALE:
+        v = stage.a * v + stage.b;
+        break;
+      case STAGE_THRESHOLD:
+        v = (v >= stage.a) ? 1 : 0;
+        break;
+      case STAGE_CLAMP:
+        v = min(max(v, 0.0f), 1.0f);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+
+/*
+run the pipeline over inputpixmap into outputpixmap
+  the input channels are kept as float planes with a reflected border of the summed kernel radii,
+  each tile and channel then runs through all the stages on buffers that only cover the tile and its halo
+*/
+void runPipeline(const vector<PipelineStage> &stages, ThreadPool &pool)
+{
+  // margin[s]: halo the input of stage s needs, the summed radii of the kernel stages from s on
+  vector<int> margin(stages.size() + 1, 0);
+  for (int s = stages.size() - 1; s >= 0; s--)  {margin[s] = margin[s + 1] + (stages[s].size - 1) / 2;}
+
+  Plane<float> *planes = new Plane<float> [inputChannels];
+  for (int channel = 0; channel < inputChannels; channel++)
+  {
+    planes[channel].allocate(xres, yres, margin[0]);
+    for (int row = 0; row < yres; row++)
+    {
+      float *dst = planes[channel].row(row);
+      const unsigned char *src = inputpixmap + row * xres * inputChannels + channel;
+      for (int col = 0; col < xres; col++)  {dst[col] = float(src[col * inputChannels]) / 255;}
+    }
+    planes[channel].reflectBorder();
+  }
+  outputpixmap = new unsigned char [xres * yres * inputChannels];
+
+  int tiles_x = (xres + PIPELINE_TILE - 1) / PIPELINE_TILE;
+  int tiles_y = (yres + PIPELINE_TILE - 1) / PIPELINE_TILE;
+  cout << "Pipeline: " << stages.size() << " stages, halo " << margin[0] << " Threads: " << pool.size() << " Tiles: " << tiles_x * tiles_y << endl;
+
+  pool.parallelFor(tiles_x * tiles_y, [&](int t)
+  {
+    int row0 = (t / tiles_x) * PIPELINE_TILE;
+    int col0 = (t % tiles_x) * PIPELINE_TILE;
+    int th = min(PIPELINE_TILE, yres - row0);
+    int tw = min(PIPELINE_TILE, xres - col0);
+    TileBuffer current, next;
+    for (int channel = 0; channel < inputChannels; channel++)
+    {
+      int m = margin[0];
+      current.allocate(row0 - m, col0 - m, th + 2 * m, tw + 2 * m);
+      for (int y = 0; y < current.h; y++)
+      {
+        const float *src = planes[channel].row(current.row0 + y) + current.col0;
+        copy(src, src + current.w, current.row(current.row0 + y));
+      }
+      for (size_t s = 0; s < stages.size(); s++)
+      {
+        if (stages[s].type != STAGE_KERNEL) {applyPoint(stages[s], current);  continue;}
+        m = margin[s + 1];
+        next.allocate(row0 - m, col0 - m, th + 2 * m, tw + 2 * m);
+        applyKernel(stages[s], current, next);
+        reflectEdges(next);
+        swap(current, next);
+      }
+      for (int y = 0; y < th; y++)
+      {
+        const float *src = current.row(row0 + y);
+        unsigned char *dst = outputpixmap + ((row0 + y) * xres + col0) * inputChannels + channel;
+        // scale the output value to 0-255: 255 times the absolute value, clamped
+        for (int x = 0; x < tw; x++)  {dst[x * inputChannels] = 255 * min(fabs(src[x]), 1.0f);}
+      }
+    }
+  });
+
+  delete [] planes;
+}
@@ -0,0 +1,40 @@
+/*
+Multi-pass filter pipeline of filt: kernels and point operations applied one after the other.
+The stages are fused tile by tile: every tile of the output runs through all stages
+on small float buffers, so no intermediate image is ever held in full.
+Every stage sees its input reflected at the image edges, as if the stages ran one at a time on whole images.
+
+Jingcong Zhang
+jingcoz@g.clemson.edu
+*/
+
+# ifndef PIPELINE_H
+# define PIPELINE_H
+
+# include <vector>
+
+# include "threadpool.h"
+
+enum StageType {STAGE_KERNEL, STAGE_ABS, STAGE_SCALE, STAGE_THRESHOLD, STAGE_CLAMP};
+
+// one stage of a pipeline
+struct PipelineStage
+{
+  StageType type;
+  // kernel: flipped 2D weights, or rank flipped separable factors of size values each
+  int size;
+  int rank;
+  std::vector<double> weights;
+  std::vector<double> cols, rows;
+  // point operations: scale a * v + b, threshold v >= a ? 1 : 0
+  double a, b;
+};
+
+// capture the current kernel and its separable factors as a pipeline stage
+PipelineStage kernelStage();
+PipelineStage pointStage(StageType type, double a = 0, double b = 0);
+
+// run the stages over inputpixmap into outputpixmap, 255 times the absolute value clamped to 1
+void runPipeline(const std::vector<PipelineStage> &stages, ThreadPool &pool);
+
+# endif
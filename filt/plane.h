@@ -0,0 +1,129 @@
+/*
+Image plane: a single aligned allocation with a row stride
+and a border apron around the image, filled by reflecting the image at its edges.
+Kernels up to the border radius can read past the image edges without any index checks.
+A plane holds one channel, or several channels interleaved pixel by pixel.
+
+Jingcong Zhang
+jingcoz@g.clemson.edu
+*/
+
+# ifndef PLANE_H
+# define PLANE_H
+
+# include <cstddef>
+# include <cstdlib>
+# include <cstring>
+
+const int PLANE_ALIGN = 64;   // row alignment in bytes: one cache line, also enough for AVX loads
+
+
+/*
+reflect an index into [0, total) without repeating the edge pixel: -1 -> 1, total -> total - 2
+  indices further out keep reflecting back and forth
+*/
+inline int reflectIndex(int index, int total)
+{
+  if (total == 1) {return 0;}
+  int period = 2 * (total - 1);
+  index %= period;
+  if (index < 0)  {index += period;}
+  return (index < total) ? index : period - index;
+}
+
+
+template <class T>
+class Plane
+{
+public:
+  Plane() : memory(NULL), origin(NULL), w(0), h(0), b(0), c(1), s(0) {}
+  Plane(int width, int height, int border = 0, int channels = 1) : memory(NULL) {allocate(width, height, border, channels);}
+  ~Plane() {release();}
+
+  // width, height and border are in pixels, a pixel holds channels values
+  void allocate(int width, int height, int border = 0, int channels = 1);
+  void release();
+
+  int width() const {return w;}
+  int height() const {return h;}
+  int border() const {return b;}
+  int channels() const {return c;}
+  int stride() const {return s;}   // distance between rows in values
+
+  // pixel (0, y), channel k of pixel x is at row(y)[x * channels + k]
+  // rows -border ... height + border - 1 and columns -border ... width + border - 1 are valid
+  T *row(int y) {return origin + ptrdiff_t(y) * s;}
+  const T *row(int y) const {return origin + ptrdiff_t(y) * s;}
+
+  // fill the border apron by reflecting the image at its edges
+  void reflectBorder();
+  // fill the left and right apron of row y only
+  void reflectColumns(int y);
+
+private:
+  char *memory;
+  T *origin;  // pixel (0, 0), aligned to PLANE_ALIGN
+  int w, h, b, c, s;
+
+  // planes own their memory, no copies
+  Plane(const Plane &);
+  Plane &operator=(const Plane &);
+};
+
+
+template <class T>
+void Plane<T>::allocate(int width, int height, int border, int channels)
+{
+  release();
+  w = width;
+  h = height;
+  b = border;
+  c = channels;
+  // pad the left border and the stride to whole cache lines so every row starts aligned
+  int align = (PLANE_ALIGN % sizeof(T) == 0) ? PLANE_ALIGN / sizeof(T) : 1;
+  int lead = (b * c + align - 1) / align * align;
+  s = (lead + (w + b) * c + align - 1) / align * align;
+  memory = new char [size_t(s) * (h + 2 * b) * sizeof(T) + PLANE_ALIGN];
+  size_t offset = (PLANE_ALIGN - size_t(memory) % PLANE_ALIGN) % PLANE_ALIGN;
+  origin = (T *)(memory + offset) + size_t(s) * b + lead;
+}
+
+
+template <class T>
+void Plane<T>::release()
+{
+  delete [] memory;
+  memory = NULL;
+  origin = NULL;
+}
+
+
+template <class T>
+void Plane<T>::reflectBorder()
+{
+  if (b == 0) {return;}
+  for (int y = 0; y < h; y++)  {reflectColumns(y);}
+  // whole padded rows, so the corners are reflected in both directions
+  for (int y = 1; y <= b; y++)
+  {
+    memcpy(row(-y) - b * c, row(reflectIndex(-y, h)) - b * c, (w + 2 * b) * c * sizeof(T));
+    memcpy(row(h - 1 + y) - b * c, row(reflectIndex(h - 1 + y, h)) - b * c, (w + 2 * b) * c * sizeof(T));
+  }
+}
+
+
+template <class T>
+void Plane<T>::reflectColumns(int y)
+{
+  T *r = row(y);
+  for (int x = 1; x <= b; x++)
+  {
+    for (int k = 0; k < c; k++)
+    {
+      r[-x * c + k] = r[reflectIndex(-x, w) * c + k];
+      r[(w - 1 + x) * c + k] = r[reflectIndex(w - 1 + x, w) * c + k];
+    }
+  }
+}
+
+# endif
@@ -0,0 +1,264 @@
+/*
+Vectorized convolution kernels for the reduced precision modes of filt.
+
+Jingcong Zhang
+jingcoz@g.clemson.edu
+*/
+
+# include "simd.h"
+# include <vector>
+
+# if defined(__x86_64__) || defined(__i386__)
+#   define FILT_X86
+#   include <immintrin.h>
+# endif
+
+using namespace std;
+
+
+/*
+scalar loops, also used for the pixels left over at the right end of a row
+*/
+static void convRectFloatScalar(const float *src, int stride, const float *w, int kh, int kw,
+                                float *dst, int x0, int x1, int y, bool accumulate)
+{
+  for (int x = x0; x < x1; x++)
+  {
+    float sum = 0;
+    for (int i = 0; i < kh; i++)
+    {
+      const float *s = src + (y + i) * stride + x;
+      for (int j = 0; j < kw; j++)  {sum = sum + w[i * kw + j] * s[j];}
+    }
+    dst[x] = accumulate ? dst[x] + sum : sum;
+  }
+}
+
+static void convRectInt16Scalar(const int16_t *src, int stride, const int16_t *w, int kh, int kw,
+                                int32_t *dst, int x0, int x1, int y)
+{
+  for (int x = x0; x < x1; x++)
+  {
+    int32_t sum = 0;
+    for (int i = 0; i < kh; i++)
+    {
+      const int16_t *s = src + (y + i) * stride + x;
+      for (int j = 0; j < kw; j++)  {sum += int32_t(w[i * kw + j]) * s[j];}
+    }
+    dst[x] = sum;
+  }
+}
+
+
+/*
+pack the weights of each kernel row in pairs for the multiply-add instructions:
+the low half of a 32 bit word holds w[2p], the high half w[2p + 1], an odd row is padded with 0
+*/
+static void pairWeights(const int16_t *w, int kh, int kw, vector<int32_t> &pairs)
+{
+  int np = (kw + 1) / 2;
+  pairs.resize(kh * np);
+  for (int i = 0; i < kh; i++)
+  {
+    for (int p = 0; p < np; p++)
+    {
+      uint16_t lo = uint16_t(w[i * kw + 2 * p]);
+      uint16_t hi = (2 * p + 1 < kw) ? uint16_t(w[i * kw + 2 * p + 1]) : 0;
+      pairs[i * np + p] = int32_t(uint32_t(lo) | (uint32_t(hi) << 16));
+    }
+  }
+}
+
+
+# ifdef FILT_X86
+
+__attribute__((target("avx2")))
+static void convRectFloatAVX2(const float *src, int stride, const float *w, int kh, int kw,
+                              float *dst, int dst_stride, int tw, int th, bool accumulate)
+{
+  for (int y = 0; y < th; y++)
+  {
+    float *d = dst + y * dst_stride;
+    int x = 0;
+    for (; x + 16 <= tw; x += 16)
+    {
+      __m256 acc0 = _mm256_setzero_ps();
+      __m256 acc1 = _mm256_setzero_ps();
+      for (int i = 0; i < kh; i++)
+      {
+        const float *s = src + (y + i) * stride + x;
+        const float *wr = w + i * kw;
+        for (int j = 0; j < kw; j++)
+        {
+          __m256 wv = _mm256_set1_ps(wr[j]);
+          acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(wv, _mm256_loadu_ps(s + j)));
+          acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(wv, _mm256_loadu_ps(s + j + 8)));
+        }
+      }
+      if (accumulate)
+      {
+        acc0 = _mm256_add_ps(_mm256_loadu_ps(d + x), acc0);
+        acc1 = _mm256_add_ps(_mm256_loadu_ps(d + x + 8), acc1);
+      }
+      _mm256_storeu_ps(d + x, acc0);
+      _mm256_storeu_ps(d + x + 8, acc1);
+    }
+    for (; x + 8 <= tw; x += 8)
+    {
+      __m256 acc = _mm256_setzero_ps();
+      for (int i = 0; i < kh; i++)
+      {
+        const float *s = src + (y + i) * stride + x;
+        const float *wr = w + i * kw;
+        for (int j = 0; j < kw; j++)  {acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(wr[j]), _mm256_loadu_ps(s + j)));}
+      }
+      if (accumulate) {acc = _mm256_add_ps(_mm256_loadu_ps(d + x), acc);}
+      _mm256_storeu_ps(d + x, acc);
+    }
+    convRectFloatScalar(src, stride, w, kh, kw, d, x, tw, y, accumulate);
+  }
+}
+
+__attribute__((target("avx2")))
+static void convRectInt16AVX2(const int16_t *src, int stride, const int16_t *w, int kh, int kw,
+                              int32_t *dst, int dst_stride, int tw, int th)
+{
+  vector<int32_t> pairs;
+  pairWeights(w, kh, kw, pairs);
+  int np = (kw + 1) / 2;
+  for (int y = 0; y < th; y++)
+  {
+    int32_t *d = dst + y * dst_stride;
+    int x = 0;
+    for (; x + 16 <= tw; x += 16)
+    {
+      // unpack interleaves within each 128 bit lane: lo holds pixels 0-3 and 8-11, hi holds 4-7 and 12-15
+      __m256i lo = _mm256_setzero_si256();
+      __m256i hi = _mm256_setzero_si256();
+      for (int i = 0; i < kh; i++)
+      {
+        const int16_t *s = src + (y + i) * stride + x;
+        for (int p = 0; p < np; p++)
+        {
+          __m256i v0 = _mm256_loadu_si256((const __m256i *)(s + 2 * p));
+          __m256i v1 = _mm256_loadu_si256((const __m256i *)(s + 2 * p + 1));
+          __m256i wv = _mm256_set1_epi32(pairs[i * np + p]);
+          lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(v0, v1), wv));
+          hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(v0, v1), wv));
+        }
+      }
+      _mm256_storeu_si256((__m256i *)(d + x), _mm256_permute2x128_si256(lo, hi, 0x20));
+      _mm256_storeu_si256((__m256i *)(d + x + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    convRectInt16Scalar(src, stride, w, kh, kw, d, x, tw, y);
+  }
+}
+
+static void convRectFloatSSE(const float *src, int stride, const float *w, int kh, int kw,
+                             float *dst, int dst_stride, int tw, int th, bool accumulate)
+{
+  for (int y = 0; y < th; y++)
+  {
+    float *d = dst + y * dst_stride;
+    int x = 0;
+    for (; x + 8 <= tw; x += 8)
+    {
+      __m128 acc0 = _mm_setzero_ps();
+      __m128 acc1 = _mm_setzero_ps();
+      for (int i = 0; i < kh; i++)
+      {
+        const float *s = src + (y + i) * stride + x;
+        const float *wr = w + i * kw;
+        for (int j = 0; j < kw; j++)
+        {
+          __m128 wv = _mm_set1_ps(wr[j]);
+          acc0 = _mm_add_ps(acc0, _mm_mul_ps(wv, _mm_loadu_ps(s + j)));
+          acc1 = _mm_add_ps(acc1, _mm_mul_ps(wv, _mm_loadu_ps(s + j + 4)));
+        }
+      }
+      if (accumulate)
+      {
+        acc0 = _mm_add_ps(_mm_loadu_ps(d + x), acc0);
+        acc1 = _mm_add_ps(_mm_loadu_ps(d + x + 4), acc1);
+      }
+      _mm_storeu_ps(d + x, acc0);
+      _mm_storeu_ps(d + x + 4, acc1);
+    }
+    convRectFloatScalar(src, stride, w, kh, kw, d, x, tw, y, accumulate);
+  }
+}
+
+static void convRectInt16SSE(const int16_t *src, int stride, const int16_t *w, int kh, int kw,
+                             int32_t *dst, int dst_stride, int tw, int th)
+{
+  vector<int32_t> pairs;
+  pairWeights(w, kh, kw, pairs);
+  int np = (kw + 1) / 2;
+  for (int y = 0; y < th; y++)
+  {
+    int32_t *d = dst + y * dst_stride;
+    int x = 0;
+    for (; x + 8 <= tw; x += 8)
+    {
+      __m128i lo = _mm_setzero_si128();
+      __m128i hi = _mm_setzero_si128();
+      for (int i = 0; i < kh; i++)
+      {
+        const int16_t *s = src + (y + i) * stride + x;
+        for (int p = 0; p < np; p++)
+        {
+          __m128i v0 = _mm_loadu_si128((const __m128i *)(s + 2 * p));
+          __m128i v1 = _mm_loadu_si128((const __m128i *)(s + 2 * p + 1));
+          __m128i wv = _mm_set1_epi32(pairs[i * np + p]);
+          lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(v0, v1), wv));
+          hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(v0, v1), wv));
+        }
+      }
+      _mm_storeu_si128((__m128i *)(d + x), lo);
+      _mm_storeu_si128((__m128i *)(d + x + 4), hi);
+    }
+    convRectInt16Scalar(src, stride, w, kh, kw, d, x, tw, y);
+  }
+}
+
+static bool hasAVX2()
+{
+  static bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2;
+}
+
+# endif
+
+
+const char *simdName()
+{
+# ifdef FILT_X86
+  return hasAVX2() ? "avx2" : "sse2";
+# else
+  return "scalar";
+# endif
+}
+
+
+void convRectFloat(const float *src, int stride, const float *w, int kh, int kw,
+                   float *dst, int dst_stride, int tw, int th, bool accumulate)
+{
+# ifdef FILT_X86
+  if (hasAVX2())  {convRectFloatAVX2(src, stride, w, kh, kw, dst, dst_stride, tw, th, accumulate);}
+  else  {convRectFloatSSE(src, stride, w, kh, kw, dst, dst_stride, tw, th, accumulate);}
+# else
+  for (int y = 0; y < th; y++)  {convRectFloatScalar(src, stride, w, kh, kw, dst + y * dst_stride, 0, tw, y, accumulate);}
+# endif
+}
+
+
+void convRectInt16(const int16_t *src, int stride, const int16_t *w, int kh, int kw,
+                   int32_t *dst, int dst_stride, int tw, int th)
+{
+# ifdef FILT_X86
+  if (hasAVX2())  {convRectInt16AVX2(src, stride, w, kh, kw, dst, dst_stride, tw, th);}
+  else  {convRectInt16SSE(src, stride, w, kh, kw, dst, dst_stride, tw, th);}
+# else
+  for (int y = 0; y < th; y++)  {convRectInt16Scalar(src, stride, w, kh, kw, dst + y * dst_stride, 0, tw, y);}
+# endif
+}
@@ -0,0 +1,35 @@
+/*
+Vectorized convolution kernels for the reduced precision modes of filt.
+The kernels work on a contiguous tile that already carries its reflected halo,
+so every output pixel takes the same branch-free path.
+AVX2 or SSE2 is picked at run time, other processors use the scalar loops.
+All paths sum the taps in the same order, the result does not depend on the instruction set.
+
+Jingcong Zhang
+jingcoz@g.clemson.edu
+*/
+
+# ifndef SIMD_H
+# define SIMD_H
+
+# include <stdint.h>
+
+// instruction set used by the kernels: "avx2", "sse2" or "scalar"
+const char *simdName();
+
+/*
+single precision rectangular kernel
+  dst[y][x] (+)= sum of w[i * kw + j] * src[(y + i) * stride + x + j], i < kh, j < kw
+  for a tw x th output, src holds (th + kh - 1) rows of at least (tw + kw - 1) values
+*/
+void convRectFloat(const float *src, int stride, const float *w, int kh, int kw,
+                   float *dst, int dst_stride, int tw, int th, bool accumulate);
+
+/*
+fixed-point rectangular kernel on 16 bit samples and weights, summed exactly in 32 bits
+  same layout as convRectFloat, src rows must be readable for one value past tw + kw - 1
+*/
+void convRectInt16(const int16_t *src, int stride, const int16_t *w, int kh, int kw,
+                   int32_t *dst, int dst_stride, int tw, int th);
+
+# endif
@@ -0,0 +1,95 @@
+/*
+Simple thread pool to run independent tasks in parallel.
+
+Jingcong Zhang
+jingcoz@g.clemson.edu
+*/
+
+# include "threadpool.h"
+
+using namespace std;
+
+
+ThreadPool::ThreadPool(int n)
+{
+  nthreads = (n < 1) ? 1 : n;
+  job = NULL;
+  job_count = 0;
+  next_task = 0;
+  generation = 0;
+  busy = 0;
+  quit = false;
+  for (int i = 1; i < nthreads; i++)  {workers.push_back(thread(&ThreadPool::workerLoop, this));}
+}
+
+
+ThreadPool::~ThreadPool()
+{
+  {
+    unique_lock<mutex> guard(lock);
+    quit = true;
+  }
+  wakeup.notify_all();
+  for (size_t i = 0; i < workers.size(); i++)  {workers[i].join();}
+}
+
+
+/*
+take tasks of the current job until none is left
+*/
+void ThreadPool::runTasks()
+{
+  int task;
+  while ((task = next_task++) < job_count)  {(*job)(task);}
+}
+
+
+/*
+worker thread: wait for a new job, help to run it, report back
+*/
+void ThreadPool::workerLoop()
+{
+  int seen = 0;
+  while (true)
+  {
+    {
+      unique_lock<mutex> guard(lock);
+      while (!quit and generation == seen)  {wakeup.wait(guard);}
+      if (quit) {return;}
+      seen = generation;
+    }
+    runTasks();
+    {
+      unique_lock<mutex> guard(lock);
+      if (--busy == 0)  {finished.notify_one();}
+    }
+  }
+}
+
+
+void ThreadPool::parallelFor(int count, const function<void(int)> &task)
+{
+  if (count <= 0) {return;}
+  // nothing to share: run on the calling thread
+  if (workers.empty() or count == 1)
+  {
+    for (int i = 0; i < count; i++) {task(i);}
+    return;
+  }
+
+  {
+    unique_lock<mutex> guard(lock);
+    job = &task;
+    job_count = count;
+    next_task = 0;
+    busy = workers.size();
+    generation++;
+  }
+  wakeup.notify_all();
+  runTasks();
+
+  // wait for the workers to leave the job before the task goes out of scope
+  unique_lock<mutex> guard(lock);
+  while (busy > 0)  {finished.wait(guard);}
+  job = NULL;
+}
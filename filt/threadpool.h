@@ -0,0 +1,47 @@
+/*
+Simple thread pool to run independent tasks in parallel.
+The worker threads are started once and reused for every parallelFor() call,
+the calling thread also takes tasks while it waits.
+
+Jingcong Zhang
+jingcoz@g.clemson.edu
+*/
+
+# ifndef THREADPOOL_H
+# define THREADPOOL_H
+
+# include <vector>
+# include <thread>
+# include <mutex>
+# include <condition_variable>
+# include <functional>
+# include <atomic>
+
+class ThreadPool
+{
+public:
+  ThreadPool(int nthreads);
+  ~ThreadPool();
+
+  int size() const {return nthreads;}
+  // run task(0) ... task(count - 1) on the pool and wait until all of them finish
+  void parallelFor(int count, const std::function<void(int)> &task);
+
+private:
+  int nthreads;   // number of threads including the calling thread
+  std::vector<std::thread> workers;
+  std::mutex lock;
+  std::condition_variable wakeup;   // signals workers that a new job is posted
+  std::condition_variable finished;   // signals the caller that all workers left the job
+  const std::function<void(int)> *job;
+  int job_count;
+  std::atomic<int> next_task;
+  int generation;   // incremented for every posted job
+  int busy;   // workers still working on the current job
+  bool quit;
+
+  void workerLoop();
+  void runTasks();
+};
+
+# endif
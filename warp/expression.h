@@ -0,0 +1,72 @@
+/*
+Compiler of user warp formulas, such as "pow(x, 0.25)" or "r * cos(a + p * r) / 2 + 0.5".
+A formula is parsed once into a flat program for a small stack machine, with the constant parts folded,
+and the program is then run for every pixel.
+Formulas have + - * / ^, unary -, parentheses, numbers, the constants pi and e, the variables named
+by the program, and the functions sin cos tan asin acos atan sinh cosh tanh sqrt exp log abs floor ceil
+of one argument and pow atan2 min max fmod of two.
+
+Jingcong Zhang
+jingcoz@g.clemson.edu
+*/
+
+# ifndef EXPRESSION_H
+# define EXPRESSION_H
+
+# include <string>
+# include <vector>
+
+class Expression
+{
+public:
+  Expression();
+
+  // compile a formula over the named variables, false with a message in error if it does not parse
+  bool compile(const std::string &text, const std::vector<std::string> &variables, std::string &error);
+
+  // value of the formula, values holds the variables in the order given to compile
+  double eval(const double *values) const;
+
+  // true if the formula reads the variable of that index
+  bool uses(int variable) const;
+
+  const std::string &text() const {return source;}
+
+private:
+  enum OpCode {PUSH, LOAD, ADD, SUB, MUL, DIV, NEG, SQUARE, CALL1, CALL2};
+  struct Op
+  {
+    OpCode code;
+    double value;  // PUSH
+    int index;  // LOAD
+    double (*f1)(double);  // CALL1
+    double (*f2)(double, double);  // CALL2
+  };
+  static const int MAX_DEPTH = 64;  // stack size of eval
+
+  std::string source;
+  std::vector<std::string> names;
+  std::vector<Op> program;
+  std::vector<bool> used;
+  int depth, max_depth;
+
+  // parser state
+  size_t pos;
+  std::string message;
+
+  void skipSpace();
+  bool accept(char c);
+  bool parseSum();
+  bool parseProduct();
+  bool parseUnary();
+  bool parsePower();
+  bool parsePrimary();
+  bool fail(const std::string &what);
+  void emit(const Op &op, int pops);
+  void emitPush(double value);
+  void emitOp(OpCode code);
+  void emitCall1(double (*f)(double));
+  void emitCall2(double (*f)(double, double));
+};
+
+# endif
@@ -4,7 +4,8 @@ and optionally write out the image to an image file.
 Input image and output image will keep the same size.
 
 Usage: 
-tile row_number column_number input_image_name [output_image_name]
+tile row_number column_number input_image_name [output_image_name] [-j threads]
+-j threads: number of threads of the inverse mapping, default all cores
 
 Mouse Response:
   Left click any of the displayed windows to quit the program.
@@ -24,6 +25,7 @@ jingcoz@g.clemson.edu
 # include <math.h>
 # include <cmath>
 # include <iomanip>
+# include <thread>
 
 # ifdef __APPLE__
 #   pragma clang diagnostic ignored "-Wdeprecated-declarations"
@@ -32,6 +34,8 @@ jingcoz@g.clemson.edu
 #   include <GL/glut.h>
 # endif
 
+# include "threadpool.h"
+
 using namespace std;
 OIIO_NAMESPACE_USING
 
@@ -40,12 +44,14 @@ static unsigned char *inputpixmap;  // input image pixels pixmap
 static unsigned char *outputpixmap; // output image pixels pixmap
 static int xres, yres;  // input image size: width, height
 static int xres_out, yres_out;  // output image size: width, height
+static int nthreads;  // number of threads of the inverse mapping
 
 
 /*
 tile original image to create the same size tiled image
+  output rows are inverse mapped in parallel
 */
-void tileimage(int nrows, int ncols)
+void tileimage(int nrows, int ncols, ThreadPool &pool)
 {
   // tiled image keep the same size as original image
   xres_out = xres;
@@ -56,10 +62,10 @@ void tileimage(int nrows, int ncols)
   // fill the output image with a clear transparent color(0, 0, 0, 0)
   for (int i = 0; i < xres_out * yres_out * 4; i++) {outputpixmap[i] = 0;}
 
-  // inverse map
-  double x, y, u, v;
-  for (int row_out = 0; row_out < yres_out; row_out++)  // output row
+  // inverse map: one task per output row
+  pool.parallelFor(yres_out, [&](int row_out)  // output row
   {
+    double x, y, u, v;
     for (int col_out = 0; col_out < xres_out; col_out++)  // output col
     {
       // coordinate normalization
@@ -83,7 +89,7 @@ void tileimage(int nrows, int ncols)
         {outputpixmap[(row_out * xres_out + col_out) * 4 + k] = inputpixmap[(row_in * xres + col_in) * 4 + k];}
       }
     }
-  }
+  });
 }
 
 
@@ -259,12 +265,30 @@ void handleReshape_in(int w, int h) {handleReshape(w, h, xres, yres);}
 void handleReshape_out(int w, int h)  {handleReshape(w, h, xres_out, yres_out);}
 
 
+/*
+take an option with a value out of the argument list, return its value or "" if it is not given
+*/
+string takeOption(int &argc, char **argv, const string &option)
+{
+  char **iter = find(argv, argv + argc, option);
+  if (iter == argv + argc)  {return "";}
+  if (iter + 1 == argv + argc)  {cout << "Missing value for option " << option << endl; exit(0);}
+  string value = iter[1];
+  for (char **p = iter; p + 2 < argv + argc; p++)  {p[0] = p[2];}
+  argc -= 2;
+  argv[argc] = NULL;
+  return value;
+}
+
+
 /*
 command line options parser
-  tile row_number col_number input_image_name [output_image_name](optional).
+  tile row_number col_number input_image_name [output_image_name](optional) [-j threads]
 */
-void getCmdOptions(int argc, char* argv[], int &nrows, int &ncols, string &inputImage, string &outputImage)
+void getCmdOptions(int &argc, char* argv[], int &nrows, int &ncols, string &inputImage, string &outputImage)
 {
+  string threads = takeOption(argc, argv, "-j");
+  nthreads = (threads != "") ? atoi(threads.c_str()) : thread::hardware_concurrency();
   if (argc >= 4)
   {
     nrows = atoi(argv[1]);
@@ -277,7 +301,7 @@ void getCmdOptions(int argc, char* argv[], int &nrows, int &ncols, string &input
   else  
   {
     cout << "[HELP]" << endl;
-    cout << "[Usage] tile row_number col_number input_image_name [output_image_name](optional)." << endl;
+    cout << "[Usage] tile row_number col_number input_image_name [output_image_name](optional) [-j threads]." << endl;
     exit(0);
   }
 }
@@ -298,7 +322,8 @@ int main(int argc, char* argv[])
   // read input image
   readimage(inputImage);
   // warp the original image
-  tileimage(nrows, ncols);
+  ThreadPool pool(nthreads);
+  tileimage(nrows, ncols, pool);
   // write out to an output image file
   if (outputImage != "") {writeimage(outputImage);}
   
@@ -8,8 +8,11 @@ The program provide two types of warp operation:
 The default mode is twirl image with warp parameter 2.
 
 Usage: 
-warp input_image_name [output_image_name] [mode] [warp_parameter]
-[mode] = 1, 2, 3 (only mode 2 has a warp parameter)
+warp input_image_name [output_image_name] [mode] [warp_parameter] [-j threads] [-u formula -v formula]
+[mode] = 1, 2, 3 (only mode 2 has a warp parameter), 4 with formulas
+-j threads: number of threads of the inverse mapping, default all cores
+-u formula -v formula: mode 4 - user inverse map, u and v of the normalized output coordinates x, y,
+                       their polar coordinates r, a around the image center and the warp parameter p
 
 Mouse Response:
   Left click any of the displayed windows to quit the program.
@@ -29,14 +32,23 @@ jingcoz@g.clemson.edu
 # include <math.h>
 # include <cmath>
 # include <iomanip>
-
-# ifdef __APPLE__
-#   pragma clang diagnostic ignored "-Wdeprecated-declarations"
-#   include <GLUT/glut.h>
-# else
-#   include <GL/glut.h>
+# include <vector>
+# include <thread>
+# include <functional>
+
+// WARP_NO_GL builds warp without OpenGL and GLUT, it writes the output image and displays nothing
+# ifndef WARP_NO_GL
+#   ifdef __APPLE__
+#     pragma clang diagnostic ignored "-Wdeprecated-declarations"
+#     include <GLUT/glut.h>
+#   else
+#     include <GL/glut.h>
+#   endif
 # endif
 
+# include "threadpool.h"
+# include "expression.h"
+
 using namespace std;
 OIIO_NAMESPACE_USING
 
@@ -45,138 +57,467 @@ static unsigned char *inputpixmap;  // input image pixels pixmap
 static unsigned char *outputpixmap; // output image pixels pixmap
 static int xres, yres;  // input image size: width, height
 static int xres_out, yres_out;  // output image size: width, height
+static int nthreads;  // number of threads of the inverse mapping
+
+
+// range of the warped image in normalized coordinates
+struct Bounds
+{
+  double x_min, x_max, y_min, y_max;
+
+  void include(double x, double y)
+  {
+    x_min = min(x, x_min);  x_max = max(x, x_max);
+    y_min = min(y, y_min);  y_max = max(y, y_max);
+  }
+};
 
 
 /*
-warp image
+forward mapping functions: normalized input coordinate (u, v) to normalized output coordinate (x, y)
   mode 1 - stretch image
   mode 2 - twirl image
   mode 3 - magnifying glass effect
 */
-void warpimage(int mode, double parameter)
-{ 
-  // twirl image transformation parameters
-  double twirl_f = parameter;
+void forwardMap(int mode, double parameter, double u, double v, double &x, double &y)
+{
+  double uu, vv, r, theta;
+  switch (mode)
+  {
+    case 1:
+      // warp function 1
+      x = pow(u, 4.0);
+      y = (2 / M_PI) * asin(pow(v, 0.5));
+      break;
+    case 2:
+      // warp function 2: twirl image
+      uu = (u - 0.5) * 2;
+      vv = (v - 0.5) * 2;
+      r = pow((pow(uu, 2.0) + pow(vv, 2.0)), 0.5);
+      theta = atan2(vv, uu);
+      x = r * cos(theta - parameter * r) / 2 + 0.5;
+      y = r * sin(theta - parameter * r) / 2 + 0.5;
+      break;
+    case 3:
+      // warp fuction 2: magnifying len effect
+      uu = (u - 0.5) * 2;
+      vv = (v - 0.5) * 2;
+      r = pow((pow(uu, 2.0) + pow(vv, 2.0)), 0.5);
+      theta = atan2(vv, uu);
+      x = (pow((4 * r + 0.25), 0.5) / 2 - 0.25) * cos(theta) / 2 + 0.5;
+      y = (pow((4 * r + 0.25), 0.5) / 2 - 0.25) * sin(theta) / 2 + 0.5;
+      break;
+    default:
+      x = u;
+      y = v;
+      break;
+  }
+}
 
-  // get the min, max of x, y coordinates of the original image 
-  // to find the range of warpped image
-  // calculate the entire image, not only the 4 corners of the image
-  // because the max/min value of x, y coordinates may not on the corners
-  double scale_factor_x, scale_factor_y;
-  double x_max = 0;
-  double y_max = 0;
-  double x_min = 1;
-  double y_min = 1;
+
+/*
+range of the warped image: forward map every input pixel center
+  O(W*H), kept to check the analytic bounds below
+*/
+Bounds bruteForceBounds(int mode, double parameter)
+{
+  Bounds bounds;
+  forwardMap(mode, parameter, 0.5 / xres, 0.5 / yres, bounds.x_min, bounds.y_min);
+  bounds.x_max = bounds.x_min;
+  bounds.y_max = bounds.y_min;
   for (int row = 0; row < yres; row++)
   {
     for (int col = 0; col < xres; col++)
     {
-      double x, y, uu, vv, r, theta;
-      // coordinate normalization
-      double u = (float(col) + 0.5) / float(xres);
-      double v = (float(row) + 0.5) / float(yres);
-      
-      // forward mapping functions
-      switch (mode)
+      double x, y;
+      forwardMap(mode, parameter, (col + 0.5) / xres, (row + 0.5) / yres, x, y);
+      bounds.include(x, y);
+    }
+  }
+  return bounds;
+}
+
+
+/*
+range of the stretch warp: x only depends on u, y only on v, both increase
+  so the range is spanned by the first and the last pixel centers
+*/
+Bounds stretchBounds()
+{
+  Bounds bounds;
+  forwardMap(1, 0, 0.5 / xres, 0.5 / yres, bounds.x_min, bounds.y_min);
+  forwardMap(1, 0, (xres - 0.5) / xres, (yres - 0.5) / yres, bounds.x_max, bounds.y_max);
+  return bounds;
+}
+
+
+/*
+extend the bounds by one edge of the pixel center rectangle, from (u0, v0) to (u1, v1) in n pixel steps
+  every sample that is a local extremum of x or y along the edge is refined between its neighbours
+  by a golden section search, which finds the extremum of the edge between the pixel centers
+*/
+void edgeBounds(int mode, double parameter, double u0, double v0, double u1, double v1, int n, Bounds &bounds)
+{
+  vector<double> xs(n + 1), ys(n + 1);
+  for (int i = 0; i <= n; i++)
+  {
+    double t = (n > 0) ? double(i) / n : 0;
+    forwardMap(mode, parameter, u0 + t * (u1 - u0), v0 + t * (v1 - v0), xs[i], ys[i]);
+    bounds.include(xs[i], ys[i]);
+  }
+
+  const double golden = (sqrt(5.0) - 1) / 2;
+  for (int i = 1; i < n; i++)
+  {
+    // c = 0: x, c = 1: y; sign = 1: maximum, sign = -1: minimum
+    for (int c = 0; c < 2; c++)
+    {
+      const vector<double> &values = (c == 0) ? xs : ys;
+      for (int sign = -1; sign <= 1; sign += 2)
       {
-        case 1:
-          // warp function 1
-          x = pow(u, 4.0);
-          y = (2 / M_PI) * asin(pow(v, 0.5));
-          break;
-        case 2:
-          // warp function 2: twirl image
-          uu = (u - 0.5) * 2;
-          vv = (v - 0.5) * 2;
-          r = pow((pow(uu, 2.0) + pow(vv, 2.0)), 0.5);
-          theta = atan2(vv, uu);
-          x = r * cos(theta - twirl_f * r) / 2 + 0.5;
-          y = r * sin(theta - twirl_f * r) / 2 + 0.5;
-          break;
-        case 3:
-          // warp fuction 2: magnifying len effect
-          uu = (u - 0.5) * 2;
-          vv = (v - 0.5) * 2;
-          r = pow((pow(uu, 2.0) + pow(vv, 2.0)), 0.5);
-          theta = atan2(vv, uu);
-          x = (pow((4 * r + 0.25), 0.5) / 2 - 0.25) * cos(theta) / 2 + 0.5;
-          y = (pow((4 * r + 0.25), 0.5) / 2 - 0.25) * sin(theta) / 2 + 0.5;
-          break;
-        default:
-          return;
+        if (sign * values[i] < sign * values[i - 1] or sign * values[i] < sign * values[i + 1])  {continue;}
+        double a = double(i - 1) / n, b = double(i + 1) / n;
+        for (int iteration = 0; iteration < 40; iteration++)
+        {
+          double t1 = b - golden * (b - a), t2 = a + golden * (b - a);
+          double x1, y1, x2, y2;
+          forwardMap(mode, parameter, u0 + t1 * (u1 - u0), v0 + t1 * (v1 - v0), x1, y1);
+          forwardMap(mode, parameter, u0 + t2 * (u1 - u0), v0 + t2 * (v1 - v0), x2, y2);
+          bounds.include(x1, y1);
+          bounds.include(x2, y2);
+          double f1 = sign * ((c == 0) ? x1 : y1), f2 = sign * ((c == 0) ? x2 : y2);
+          if (f1 > f2) {b = t2;}
+          else {a = t1;}
+        }
       }
+    }
+  }
+}
 
-      x_max = (x > x_max) ? x : x_max;
-      y_max = (y > y_max) ? y : y_max;
-      x_min = (x < x_min) ? x : x_min;
-      y_min = (y < y_min) ? y : y_min;
+
+/*
+range of the twirl and magnifying glass warps
+  both are rotations of the plane around the image center by an angle that only depends on the radius, and a radial scaling:
+  away from the center x and y have no critical point (along the direction of the extremum the radius keeps changing them),
+  so the extrema over the pixel center rectangle lie on its perimeter, O(W+H) instead of O(W*H)
+*/
+Bounds perimeterBounds(int mode, double parameter)
+{
+  double u0 = 0.5 / xres, u1 = (xres - 0.5) / xres;
+  double v0 = 0.5 / yres, v1 = (yres - 0.5) / yres;
+  Bounds bounds;
+  forwardMap(mode, parameter, u0, v0, bounds.x_min, bounds.y_min);
+  bounds.x_max = bounds.x_min;
+  bounds.y_max = bounds.y_min;
+  edgeBounds(mode, parameter, u0, v0, u1, v0, xres - 1, bounds);  // bottom row
+  edgeBounds(mode, parameter, u0, v1, u1, v1, xres - 1, bounds);  // top row
+  edgeBounds(mode, parameter, u0, v0, u0, v1, yres - 1, bounds);  // left column
+  edgeBounds(mode, parameter, u1, v0, u1, v1, yres - 1, bounds);  // right column
+  return bounds;
+}
+
+
+/*
+range of the warped image of a warp mode
+*/
+Bounds warpBounds(int mode, double parameter)
+{
+  switch (mode)
+  {
+    case 1:
+      return stretchBounds();
+    case 2:
+    case 3:
+      return perimeterBounds(mode, parameter);
+    default:
+      return bruteForceBounds(mode, parameter);
+  }
+}
+
+
+/*
+inverse warp functions: normalized output coordinate (x, y) to normalized input coordinate (u, v)
+  x and y run over the output image, setup gives the warp parameter and the range of the warped image
+  separable() is true when u only depends on x and v only on y
+*/
+// mode 1 - stretch image
+struct StretchWarp
+{
+  void setup(double, const Bounds &) {}
+  bool separable() const {return true;}
+  void inverse(double x, double y, double &u, double &v) const
+  {
+    u = pow(x, 0.25);
+    v = pow((sin(M_PI * y / 2)), 2.0);
+  }
+};
+
+// mode 2 - twirl image
+struct TwirlWarp
+{
+  double twirl_f, scale_factor_x, scale_factor_y, x_min, y_min;
+
+  void setup(double parameter, const Bounds &bounds)
+  {
+    twirl_f = parameter;
+    scale_factor_x = bounds.x_max - bounds.x_min;
+    scale_factor_y = bounds.y_max - bounds.y_min;
+    x_min = bounds.x_min;
+    y_min = bounds.y_min;
+  }
+  bool separable() const {return false;}
+  void inverse(double x, double y, double &u, double &v) const
+  {
+    double xx = ((x * scale_factor_x + x_min) - 0.5) * 2;
+    double yy = ((y * scale_factor_y + y_min) - 0.5) * 2;
+    double r = sqrt(xx * xx + yy * yy);
+    double a = atan2(yy, xx);
+    u = (r * cos(a + twirl_f * r) / 2) + 0.5;
+    v = (r * sin(a + twirl_f * r) / 2) + 0.5;
+  }
+};
+
+// mode 3 - magnifying glass effect
+struct MagnifyWarp : TwirlWarp
+{
+  void inverse(double x, double y, double &u, double &v) const
+  {
+    double xx = ((x * scale_factor_x + x_min) - 0.5) * 2;
+    double yy = ((y * scale_factor_y + y_min) - 0.5) * 2;
+    double r = sqrt(xx * xx + yy * yy);
+    double a = atan2(yy, xx);
+    u = (r + 0.5) * r * cos(a) / 2 + 0.5;
+    v = (r + 0.5) * r * sin(a) / 2 + 0.5;
+  }
+};
+
+// mode 4 - user formulas of u and v, over x, y, the polar coordinates r, a of (2x - 1, 2y - 1) and the parameter p
+struct ExpressionWarp
+{
+  Expression u_formula, v_formula;
+  double parameter;
+  bool polar;  // r and a are only computed for formulas that read them
+
+  void setup(double p, const Bounds &)
+  {
+    parameter = p;
+    polar = u_formula.uses(2) or u_formula.uses(3) or v_formula.uses(2) or v_formula.uses(3);
+  }
+  bool separable() const {return !polar and !u_formula.uses(1) and !v_formula.uses(0);}
+  void inverse(double x, double y, double &u, double &v) const
+  {
+    double values[5] = {x, y, 0, 0, parameter};
+    if (polar)
+    {
+      double xx = (x - 0.5) * 2;
+      double yy = (y - 0.5) * 2;
+      values[2] = sqrt(xx * xx + yy * yy);
+      values[3] = atan2(yy, xx);
     }
+    u = u_formula.eval(values);
+    v = v_formula.eval(values);
   }
-  scale_factor_x = x_max - x_min;
-  scale_factor_y = y_max - y_min;
+};
 
-  // modify the output image size
-  xres_out = xres * scale_factor_x;
-  yres_out = yres * scale_factor_y;
-  // allocate memory for output pixmap: output image is 4 channels
-  outputpixmap = new unsigned char [xres_out * yres_out * 4];
-  // fill the output image with a clear transparent color(0, 0, 0, 0)
-  for (int i = 0; i < xres_out * yres_out * 4; i++) {outputpixmap[i] = 0;} 
 
-  // inverse map
-  double x, y, u, v;
-  for (int row_out = 0; row_out < yres_out; row_out++)  // output row
+// coordinate normalization of the output pixel centers
+static double normalizedX(int col_out)  {return (float(col_out) + 0.5) / float(xres_out);}
+static double normalizedY(int row_out)  {return (float(row_out) + 0.5) / float(yres_out);}
+
+
+/*
+inverse map of the output pixels with a warp function
+  Separable: the warp is inverse mapped once per output column for u and once per output row for v,
+  every pixel then reads the two tables
+*/
+template <class Warp, bool Separable>
+class PixelMap
+{
+public:
+  PixelMap(const Warp &warp)
+  {
+    double u, v;
+    u_col.resize(xres_out);
+    v_row.resize(yres_out);
+    for (int col_out = 0; col_out < xres_out; col_out++)  {warp.inverse(normalizedX(col_out), 0.5, u_col[col_out], v);}
+    for (int row_out = 0; row_out < yres_out; row_out++)  {warp.inverse(0.5, normalizedY(row_out), u, v_row[row_out]);}
+  }
+
+  void inverse(int col_out, int row_out, double &u, double &v) const {u = u_col[col_out];  v = v_row[row_out];}
+
+private:
+  vector<double> u_col, v_row;  // u of every output column and v of every output row
+};
+
+
+/*
+inverse map of the output pixels with a warp function that is not separable: every pixel is inverse mapped
+*/
+template <class Warp>
+class PixelMap<Warp, false>
+{
+public:
+  PixelMap(const Warp &w) : warp(w) {}
+
+  void inverse(int col_out, int row_out, double &u, double &v) const {warp.inverse(normalizedX(col_out), normalizedY(row_out), u, v);}
+
+private:
+  const Warp &warp;
+};
+
+
+/*
+inverse map the output image with a warp function
+  the pixel loop is instantiated for each warp and for its table or direct inverse map,
+  so the warp function is inlined into it and there is no branch on the kind of map inside;
+  output rows are inverse mapped in parallel, every output pixel only depends on its own position
+*/
+template <class Warp, bool Separable>
+void inverseMapRows(const Warp &warp, ThreadPool &pool)
+{
+  PixelMap<Warp, Separable> pixels(warp);
+  // inverse map: one task per output row, the rows are handed out one by one to balance uneven rows
+  pool.parallelFor(yres_out, [&](int row_out)  // output row
   {
+    double u, v;
     for (int col_out = 0; col_out < xres_out; col_out++)  // output col
     {
-      // coordinate normalization
-      x = (float(col_out) + 0.5) / float(xres_out);
-      y = (float(row_out) + 0.5) / float(yres_out);
-      
-      double xx, yy, r, a;
-      
       // inverse mapping functions
-      switch (mode)
-      {
-        case 1:
-          // warp fuction 1
-          u = pow(x, 0.25);
-          v = pow((sin(M_PI * y / 2)), 2.0);         
-          break;
-        case 2:
-          // warp fuction 2: twirl image
-          xx = ((x * scale_factor_x + x_min) - 0.5) * 2;
-          yy = ((y * scale_factor_y + y_min) - 0.5) * 2;
-
-          r = pow((pow(xx, 2.0) + pow(yy, 2.0)), 0.5);
-          a = atan2(yy, xx);
-          u = (r * cos(a + twirl_f * r) / 2) + 0.5;
-          v = (r * sin(a + twirl_f * r) / 2) + 0.5;
-          break;
-        case 3:
-          // warp fuction 2: magnifying len effect
-          xx = ((x * scale_factor_x + x_min) - 0.5) * 2;
-          yy = ((y * scale_factor_y + y_min) - 0.5) * 2;
-          r = pow((pow(xx, 2.0) + pow(yy, 2.0)), 0.5);
-          a = atan2(yy, xx);
-          u = (r + 0.5) * r * cos(a) / 2 + 0.5;
-          v = (r + 0.5) * r * sin(a) / 2 + 0.5;
-          break;
-        default:
-          return;      
-      }
+      pixels.inverse(col_out, row_out, u, v);
 
       if (u <= 1 && v <= 1 && u >= 0 && v >= 0)
       {
         int row_in, col_in;
         row_in = floor(v * yres); // yres = H_input
         col_in = floor(u * xres); // xres = W_input
+        // u or v of exactly 1 is on the far edge of the last pixel
+        row_in = min(row_in, yres - 1);
+        col_in = min(col_in, xres - 1);
         
         for (int k = 0; k < 4; k++)
         {outputpixmap[(row_out * xres_out + col_out) * 4 + k] = inputpixmap[(row_in * xres + col_in) * 4 + k];}
       }
     }
+  });
+}
+
+
+/*
+inverse map the output image with the pixel loop of the separable or the general inverse map,
+  chosen once for the whole image
+*/
+template <class Warp>
+void inverseMap(const Warp &warp, ThreadPool &pool)
+{
+  if (warp.separable())  {inverseMapRows<Warp, true>(warp, pool);}
+  else  {inverseMapRows<Warp, false>(warp, pool);}
+}
+
+
+// a warp mode: the range of its warped image, and its inverse map of the output image
+struct WarpMode
+{
+  string name;
+  function<Bounds(double parameter)> bounds;
+  function<void(double parameter, const Bounds &bounds, ThreadPool &pool)> warp;
+};
+static vector<WarpMode> warp_modes;  // registered warp modes, mode n is warp_modes[n - 1]
+
+
+/*
+add a warp mode, warp is copied and set up for every run of the mode
+*/
+template <class Warp>
+void registerWarp(const string &name, const function<Bounds(double parameter)> &bounds, const Warp &warp)
+{
+  WarpMode mode;
+  mode.name = name;
+  mode.bounds = bounds;
+  mode.warp = [warp](double parameter, const Bounds &range, ThreadPool &pool)
+  {
+    Warp w = warp;
+    w.setup(parameter, range);
+    inverseMap(w, pool);
+  };
+  warp_modes.push_back(mode);
+}
+
+
+/*
+register the warp modes 1 - 3
+*/
+void registerWarps()
+{
+  registerWarp("stretch image", [](double parameter) {return warpBounds(1, parameter);}, StretchWarp());
+  registerWarp("twirl image", [](double parameter) {return warpBounds(2, parameter);}, TwirlWarp());
+  registerWarp("magnifying glass effect", [](double parameter) {return warpBounds(3, parameter);}, MagnifyWarp());
+}
+
+
+/*
+register the user formulas as the next warp mode, the output keeps the input image size
+*/
+int registerExpressionWarp(const string &u_text, const string &v_text)
+{
+  ExpressionWarp warp;
+  vector<string> variables = {"x", "y", "r", "a", "p"};
+  string error;
+  if (!warp.u_formula.compile(u_text, variables, error) or !warp.v_formula.compile(v_text, variables, error))
+  {
+    cerr << "Bad warp formula: " << error << endl;
+    exit(0);
   }
+  registerWarp("u = " + u_text + ", v = " + v_text, [](double) {Bounds unit = {0, 1, 0, 1};  return unit;}, warp);
+  return warp_modes.size();
+}
+
+
+/*
+warp image
+  mode 1 - stretch image
+  mode 2 - twirl image
+  mode 3 - magnifying glass effect
+  mode 4 - user formulas
+*/
+void warpimage(int mode, double parameter, ThreadPool &pool)
+{ 
+  if (mode < 1 or mode > int(warp_modes.size())) {return;}
+  const WarpMode &warp = warp_modes[mode - 1];
+
+  // get the min, max of x, y coordinates of the original image 
+  // to find the range of warpped image
+  // the max/min value of x, y coordinates may not be on the corners, each mode gives its range analytically
+  double scale_factor_x, scale_factor_y;
+  Bounds bounds = warp.bounds(parameter);
+# ifdef WARP_CHECK_BOUNDS
+  // compare with forward mapping every pixel: the analytic range has to cover it, and differ by less than a pixel
+  Bounds brute = bruteForceBounds(mode, parameter);
+  cout << setprecision(10) << "Bounds: x " << bounds.x_min << " " << bounds.x_max << " y " << bounds.y_min << " " << bounds.y_max << endl;
+  cout << "Brute force: x " << brute.x_min << " " << brute.x_max << " y " << brute.y_min << " " << brute.y_max << endl;
+  if (bounds.x_min > brute.x_min or bounds.x_max < brute.x_max or bounds.y_min > brute.y_min or bounds.y_max < brute.y_max or
+      brute.x_min - bounds.x_min > 1.0 / xres or bounds.x_max - brute.x_max > 1.0 / xres or
+      brute.y_min - bounds.y_min > 1.0 / yres or bounds.y_max - brute.y_max > 1.0 / yres)
+  {
+    cerr << "Analytic bounds do not match the brute force bounds" << endl;
+    exit(1);
+  }
+# endif
+  double x_min = bounds.x_min;
+  double y_min = bounds.y_min;
+  double x_max = bounds.x_max;
+  double y_max = bounds.y_max;
+  scale_factor_x = x_max - x_min;
+  scale_factor_y = y_max - y_min;
+
+  // modify the output image size
+  xres_out = xres * scale_factor_x;
+  yres_out = yres * scale_factor_y;
+  // allocate memory for output pixmap: output image is 4 channels
+  outputpixmap = new unsigned char [xres_out * yres_out * 4];
+  // fill the output image with a clear transparent color(0, 0, 0, 0)
+  for (int i = 0; i < xres_out * yres_out * 4; i++) {outputpixmap[i] = 0;} 
+
+  warp.warp(parameter, bounds, pool);
 }
 
 
@@ -285,6 +626,7 @@ void writeimage(string outfilename)
 }
 
 
+# ifndef WARP_NO_GL
 /*
 display composed associated color image
 */
@@ -350,42 +692,81 @@ void handleReshape(int w, int h, int img_width, int img_height)
 // handleReshape_in for input window, handleReshape_out for output window: input image size may be different from output image size
 void handleReshape_in(int w, int h) {handleReshape(w, h, xres, yres);}
 void handleReshape_out(int w, int h)  {handleReshape(w, h, xres_out, yres_out);}
+# endif
+
+
+/*
+take an option with a value out of the argument list, return its value or "" if it is not given
+*/
+string takeOption(int &argc, char **argv, const string &option)
+{
+  char **iter = find(argv, argv + argc, option);
+  if (iter == argv + argc)  {return "";}
+  if (iter + 1 == argv + argc)  {cout << "Missing value for option " << option << endl; exit(0);}
+  string value = iter[1];
+  for (char **p = iter; p + 2 < argv + argc; p++)  {p[0] = p[2];}
+  argc -= 2;
+  argv[argc] = NULL;
+  return value;
+}
+
+
+/*
+true if the argument is the number of a registered warp mode
+*/
+bool isMode(const string &arg)
+{
+  for (size_t mode = 1; mode <= warp_modes.size(); mode++)  {if (arg == to_string(mode)) {return true;}}
+  return false;
+}
 
 
 /*
 command line options parser
-  warp input_image_name [output_image_name](optional) [warp_mode] [warp_parameter]
+  warp input_image_name [output_image_name](optional) [warp_mode] [warp_parameter] [-j threads] [-u formula -v formula]
   mode selection:     
     mode 1 - stretch image
     mode 2 - twirl image
     mode 3 - magnifying glass effect
+    mode 4 - user formulas, the default mode when they are given
 */
-void getCmdOptions(int argc, char* argv[], string &inputImage, string &outputImage, int &mode, double &parameter)
+void getCmdOptions(int &argc, char* argv[], string &inputImage, string &outputImage, int &mode, double &parameter)
 {
+  string threads = takeOption(argc, argv, "-j");
+  nthreads = (threads != "") ? atoi(threads.c_str()) : thread::hardware_concurrency();
+  string u_text = takeOption(argc, argv, "-u");
+  string v_text = takeOption(argc, argv, "-v");
+  if (u_text != "" or v_text != "")
+    {mode = registerExpressionWarp((u_text != "") ? u_text : "x", (v_text != "") ? v_text : "y");}
   if (argc >= 2)
   {
     inputImage = argv[1];
     if (argc > 2)
     {
       string tmp = argv[2];
-      if (tmp == "1" || tmp == "2" || tmp == "3") {mode = atoi(argv[2]);  if (argc > 3) {parameter = atof(argv[3]);}}
+      if (isMode(tmp)) {mode = atoi(argv[2]);  if (argc > 3) {parameter = atof(argv[3]);}}
       else
       {
         outputImage = argv[2];
         if (argc > 3)
         {
           tmp = argv[3];
-          if (tmp == "1" || tmp == "2" || tmp == "3") {mode = atoi(argv[3]);  if (argc > 4) {parameter = atof(argv[4]);}}
+          if (isMode(tmp)) {mode = atoi(argv[3]);  if (argc > 4) {parameter = atof(argv[4]);}}
         }
       }
     }
+    cout << "warp mode " << mode << ": " << warp_modes[mode - 1].name << endl;
   }
   // print help message
   else  
   {
     cout << "[HELP]" << endl;
-    cout << "[Usage] warp input_image_name [output_image_name] [warp_mode] [warp_parameter]" << endl;
+    cout << "[Usage] warp input_image_name [output_image_name] [warp_mode] [warp_parameter] [-j threads] [-u formula -v formula]" << endl;
     cout << "[warp_mode] 1 - stretch image, 2 - twirl image, 3 - magnifying len effect. Only mode 2 has a warp parameter." << endl;
+    cout << "[-j threads] number of threads of the inverse mapping, default all cores." << endl;
+    cout << "[-u formula -v formula] mode 4 - inverse map by formulas of the normalized output coordinates x, y,\n"
+         << "  their polar coordinates r, a around the image center and the warp parameter p, for example\n"
+         << "  -u \"r * cos(a + p * r) / 2 + 0.5\" -v \"r * sin(a + p * r) / 2 + 0.5\" is the twirl of mode 2." << endl;
     exit(0);
   }
 }
@@ -403,15 +784,18 @@ int main(int argc, char* argv[])
   double parameter = 2;
 
   // command line parser
+  registerWarps();
   getCmdOptions(argc, argv, inputImage, outputImage, mode, parameter);
   
   // read input image
   readimage(inputImage);
   // warp the original image
-  warpimage(mode, parameter);
+  ThreadPool pool(nthreads);
+  warpimage(mode, parameter, pool);
   // write out to an output image file
   if (outputImage != "") {writeimage(outputImage);}
-  
+
+# ifndef WARP_NO_GL
   // display input image and output image in seperated windows
   // start up the glut utilities
   glutInit(&argc, argv);
@@ -438,6 +822,7 @@ int main(int argc, char* argv[])
   // Routine that loops forever looking for events. It calls the registered
   // callback routine to handle each event that is detected
   glutMainLoop();
+# endif
 
   // release memory
   delete [] inputpixmap;
@@ -0,0 +1,58 @@
+/*
+Cache of decoded input images for the batch mode of warper.
+
+Jingcong Zhang
+jingcoz@g.clemson.edu
+*/
+
+# include "imagecache.h"
+
+using namespace std;
+
+
+ImageCache::ImageCache(size_t n, const Loader &load)
+{
+  capacity = (n < 1) ? 1 : n;
+  loader = load;
+  hit_count = 0;
+  miss_count = 0;
+}
+
+
+ImageCache::Image ImageCache::get(const string &filename)
+{
+  promise<Image> decoded;
+  shared_future<Image> image;
+  {
+    unique_lock<mutex> guard(lock);
+    map<string, Entry>::iterator found = entries.find(filename);
+    if (found != entries.end())
+    {
+      // cached or being decoded by another job: move it to the front of the use order
+      hit_count++;
+      order.splice(order.begin(), order, found -> second.use);
+      image = found -> second.image;
+      guard.unlock();
+      return image.get();
+    }
+
+    miss_count++;
+    order.push_front(filename);
+    Entry &entry = entries[filename];
+    entry.image = decoded.get_future().share();
+    entry.use = order.begin();
+    image = entry.image;
+    // drop the least recently used images, the jobs that still use one keep it alive until they finish
+    while (order.size() > capacity)
+    {
+      entries.erase(order.back());
+      order.pop_back();
+    }
+  }
+
+  // decode outside the lock, so other frames are decoded at the same time;
+  // a loader that throws hands its exception to every job waiting on this frame
+  try  {decoded.set_value(loader(filename));}
+  catch (...)  {decoded.set_exception(current_exception());}
+  return image.get();
+}
@@ -0,0 +1,61 @@
+/*
+Cache of decoded input images for the batch mode of warper.
+Jobs that warp the same frame share one decoded copy; the least recently used frames are dropped
+once the cache holds more than its capacity. A frame that one job is decoding is waited for by the
+other jobs that need it, so every frame is decoded once while it stays in the cache.
+Safe to use from the worker threads of a batch.
+
+Jingcong Zhang
+jingcoz@g.clemson.edu
+*/
+
+# ifndef IMAGECACHE_H
+# define IMAGECACHE_H
+
+# include <string>
+# include <vector>
+# include <list>
+# include <map>
+# include <memory>
+# include <mutex>
+# include <future>
+# include <functional>
+
+// decoded RGBA image, 4 bytes per pixel
+struct RGBAImage
+{
+  int width, height;
+  std::vector<unsigned char> pixels;
+};
+
+class ImageCache
+{
+public:
+  typedef std::shared_ptr<const RGBAImage> Image;
+  typedef std::function<Image(const std::string &)> Loader;
+
+  // capacity: number of decoded images kept, loader decodes an image file
+  ImageCache(size_t capacity, const Loader &loader);
+
+  // decoded image of a file, from the cache or by the loader
+  Image get(const std::string &filename);
+
+  long hits() const {return hit_count;}
+  long misses() const {return miss_count;}
+
+private:
+  struct Entry
+  {
+    std::shared_future<Image> image;
+    std::list<std::string>::iterator use;   // position in the use order
+  };
+
+  size_t capacity;
+  Loader loader;
+  std::mutex lock;
+  std::map<std::string, Entry> entries;
+  std::list<std::string> order;   // file names, most recently used first
+  long hit_count, miss_count;
+};
+
+# endif
@@ -207,11 +207,21 @@ void invbilinear(const BilinearCoeffs &c, Vector2D xy, Vector2D &uv){
 
   // cout << c.a0 << " " << c.b0 << " " << c.a1 << " " << c.b1 << " " << c.a2 << " " << c.b2 << endl;
 
-  if(fabs(c.c2) <= EPSILON){
+  if(fabs(c.c2) <= EPSILON && c.a3 == 0 && c.b3 == 0){
+    // parallelogram: the map is affine
     uv.y = (c.a1 * xy.y - c.a1 * c.b0 - c.b1 * xy.x + c.a0 * c.b1) /
       (c.a1 * c.b2 - c.a2 * c.b1);
     uv.x = (xy.x - c.a0 - c.a2 * uv.y) / c.a1;
   }
+  else if(fabs(c.c2) <= EPSILON){
+    // two opposite sides are parallel: the quadratic in v is linear, c1 * v + c0 = 0
+    c0 = c.a1 * (c.b0 - xy.y) + c.b1 * (xy.x - c.a0);
+    c1 = c.a3 * (c.b0 - xy.y) + c.b3 * (xy.x - c.a0) +
+      c.a1 * c.b2 - c.a2 * c.b1;
+    uv.y = -c0 / c1;
+    uv.x =
+      (xy.x - c.a0 - c.a2 * uv.y) / (c.a1 + c.a3 * uv.y);
+  }
   else{
     c0 = c.a1 * (c.b0 - xy.y) + c.b1 * (xy.x - c.a0);
     c1 = c.a3 * (c.b0 - xy.y) + c.b3 * (xy.x - c.a0) +
@@ -0,0 +1,299 @@
+/*
+Vectorized inverse mapping kernels of warper.
+
+Jingcong Zhang
+jingcoz@g.clemson.edu
+*/
+
+# include <vector>
+# include <atomic>
+# include "matrix.h"
+# include "simd.h"
+
+# if defined(__x86_64__) || defined(__i386__)
+#   define WARPER_X86
+#   include <immintrin.h>
+# endif
+
+using namespace std;
+
+
+bool use_simd = true;
+
+static std::atomic<long> checked_pixels(0), mismatched_pixels(0);
+
+
+/*
+scalar loops: the reference, also used for the pixels left over at the right end of a span
+*/
+static void projectiveSpanScalar(const double inv[3][3], int row_out, int col_begin, int col_end,
+                                 const uint32_t *src, int xres, int yres, uint32_t *dst)
+{
+  double y = row_out + 0.5;
+  // the parts of the homogeneous source coordinate that are the same for the whole row,
+  // summed in the order of Matrix3D::operator* so the result only differs by the reciprocal
+  double ax = inv[0][1] * y, bx = inv[0][2], dx = inv[0][0];
+  double ay = inv[1][1] * y, by = inv[1][2], dy = inv[1][0];
+  double aw = inv[2][1] * y, bw = inv[2][2], dw = inv[2][0];
+
+  if (dw == 0 && aw == 0 && bw != 0)
+  {
+    // affine: w is the same for the whole image, and 1 unless the matrix is scaled
+    double r = 1 / bw;
+    for (int col_out = col_begin; col_out < col_end; col_out++)
+    {
+      double x = col_out + 0.5;
+      int col_in = floor((dx * x + ax + bx) * r);
+      int row_in = floor((dy * x + ay + by) * r);
+      if (row_in < yres && row_in >= 0 && col_in < xres && col_in >= 0)  {dst[col_out] = src[row_in * xres + col_in];}
+    }
+    return;
+  }
+
+  for (int col_out = col_begin; col_out < col_end; col_out++)
+  {
+    double x = col_out + 0.5;
+    double w = dw * x + aw + bw;
+    // w = 0: the point is at infinity, use the homogeneous coordinate as it is like Matrix3D does
+    double r = (w != 0) ? 1 / w : 1;
+    int col_in = floor((dx * x + ax + bx) * r);
+    int row_in = floor((dy * x + ay + by) * r);
+    if (row_in < yres && row_in >= 0 && col_in < xres && col_in >= 0)  {dst[col_out] = src[row_in * xres + col_in];}
+  }
+}
+
+static void bilinearSpanScalar(const BilinearCoeffs &coeff, int row_out, int col_begin, int col_end,
+                               const uint32_t *src, int xres, int yres, uint32_t *dst)
+{
+  for (int col_out = col_begin; col_out < col_end; col_out++)
+  {
+    Vector2D xy, uv;
+    xy.x = col_out + 0.5;
+    xy.y = row_out + 0.5;
+    invbilinear(coeff, xy, uv);
+    int row_in = floor(uv.y);
+    int col_in = floor(uv.x);
+    if (row_in < yres && row_in >= 0 && col_in < xres && col_in >= 0)  {dst[col_out] = src[row_in * xres + col_in];}
+  }
+}
+
+
+# ifdef WARPER_X86
+
+/*
+x coordinates of the centers of the 8 output pixels from col_out, in two vectors of 4
+*/
+__attribute__((target("avx2")))
+static inline void pixelCenters(int col_out, __m256d &lo, __m256d &hi)
+{
+  __m256d base = _mm256_set1_pd(col_out);
+  lo = _mm256_add_pd(base, _mm256_setr_pd(0.5, 1.5, 2.5, 3.5));
+  hi = _mm256_add_pd(base, _mm256_setr_pd(4.5, 5.5, 6.5, 7.5));
+}
+
+/*
+gather the texels at the floored source coordinates (u, v) of 8 pixels into dst
+  the bounds check is done on the converted integers like the scalar loop does,
+  the pixels outside the input image are masked out of the gather and keep their value
+*/
+__attribute__((target("avx2")))
+static inline void gatherTexels(__m256d u_lo, __m256d u_hi, __m256d v_lo, __m256d v_hi,
+                                const uint32_t *src, int xres, int yres, uint32_t *dst)
+{
+  __m256i col_in = _mm256_set_m128i(_mm256_cvttpd_epi32(_mm256_floor_pd(u_hi)), _mm256_cvttpd_epi32(_mm256_floor_pd(u_lo)));
+  __m256i row_in = _mm256_set_m128i(_mm256_cvttpd_epi32(_mm256_floor_pd(v_hi)), _mm256_cvttpd_epi32(_mm256_floor_pd(v_lo)));
+  __m256i minus_one = _mm256_set1_epi32(-1);
+  __m256i inside = _mm256_and_si256(
+    _mm256_and_si256(_mm256_cmpgt_epi32(col_in, minus_one), _mm256_cmpgt_epi32(_mm256_set1_epi32(xres), col_in)),
+    _mm256_and_si256(_mm256_cmpgt_epi32(row_in, minus_one), _mm256_cmpgt_epi32(_mm256_set1_epi32(yres), row_in)));
+  __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(row_in, _mm256_set1_epi32(xres)), col_in);
+  __m256i old = _mm256_loadu_si256((const __m256i *)dst);
+  __m256i texels = _mm256_mask_i32gather_epi32(old, (const int *)src, index, inside, 4);
+  _mm256_storeu_si256((__m256i *)dst, texels);
+}
+
+__attribute__((target("avx2")))
+static void projectiveSpanAVX2(const double inv[3][3], int row_out, int col_begin, int col_end,
+                               const uint32_t *src, int xres, int yres, uint32_t *dst)
+{
+  double y = row_out + 0.5;
+  double ax = inv[0][1] * y, bx = inv[0][2], dx = inv[0][0];
+  double ay = inv[1][1] * y, by = inv[1][2], dy = inv[1][0];
+  double aw = inv[2][1] * y, bw = inv[2][2], dw = inv[2][0];
+  bool affine = (dw == 0 && aw == 0 && bw != 0);
+
+  __m256d one = _mm256_set1_pd(1);
+  __m256d ax4 = _mm256_set1_pd(ax), bx4 = _mm256_set1_pd(bx), dx4 = _mm256_set1_pd(dx);
+  __m256d ay4 = _mm256_set1_pd(ay), by4 = _mm256_set1_pd(by), dy4 = _mm256_set1_pd(dy);
+  __m256d aw4 = _mm256_set1_pd(aw), bw4 = _mm256_set1_pd(bw), dw4 = _mm256_set1_pd(dw);
+  __m256d r_affine = _mm256_set1_pd(affine ? 1 / bw : 1);
+
+  int col_out = col_begin;
+  for (; col_out + 8 <= col_end; col_out += 8)
+  {
+    __m256d x[2], u[2], v[2];
+    pixelCenters(col_out, x[0], x[1]);
+    for (int h = 0; h < 2; h++)
+    {
+      __m256d r = r_affine;
+      if (!affine)
+      {
+        // one reciprocal per pixel, 1 where w = 0
+        __m256d w = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dw4, x[h]), aw4), bw4);
+        r = _mm256_blendv_pd(one, _mm256_div_pd(one, w), _mm256_cmp_pd(w, _mm256_setzero_pd(), _CMP_NEQ_UQ));
+      }
+      u[h] = _mm256_mul_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx4, x[h]), ax4), bx4), r);
+      v[h] = _mm256_mul_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dy4, x[h]), ay4), by4), r);
+    }
+    gatherTexels(u[0], u[1], v[0], v[1], src, xres, yres, dst + col_out);
+  }
+  projectiveSpanScalar(inv, row_out, col_out, col_end, src, xres, yres, dst);
+}
+
+/*
+the quadratic of invbilinear without branches: both roots are computed,
+the second one is taken where the first one falls outside the unit square
+*/
+__attribute__((target("avx2")))
+static void bilinearSpanAVX2(const BilinearCoeffs &c, int row_out, int col_begin, int col_end,
+                             const uint32_t *src, int xres, int yres, uint32_t *dst)
+{
+  static double EPSILON = 1.0e-5;   // as in invbilinear
+  bool linear = (fabs(c.c2) <= EPSILON and c.a3 == 0 and c.b3 == 0);  // parallelogram
+  bool degenerate = (fabs(c.c2) <= EPSILON and !linear);  // two parallel sides: the quadratic is linear
+  double y = row_out + 0.5;
+
+  __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1);
+  __m256d a0 = _mm256_set1_pd(c.a0), a1 = _mm256_set1_pd(c.a1), a2 = _mm256_set1_pd(c.a2), a3 = _mm256_set1_pd(c.a3);
+  __m256d b1 = _mm256_set1_pd(c.b1), b3 = _mm256_set1_pd(c.b3);
+  __m256d width = _mm256_set1_pd(c.width), height = _mm256_set1_pd(c.height);
+  // terms that are the same for the whole row
+  __m256d b0_y = _mm256_set1_pd(c.b0 - y);
+  __m256d a1b2 = _mm256_set1_pd(c.a1 * c.b2), a2b1 = _mm256_set1_pd(c.a2 * c.b1);
+  __m256d c2_4 = _mm256_set1_pd(4.0 * c.c2), c2_2 = _mm256_set1_pd(2.0 * c.c2);
+  __m256d lin_y = _mm256_set1_pd(c.a1 * y - c.a1 * c.b0), a0b1 = _mm256_set1_pd(c.a0 * c.b1);
+  __m256d lin_den = _mm256_set1_pd(c.a1 * c.b2 - c.a2 * c.b1);
+
+  int col_out = col_begin;
+  for (; col_out + 8 <= col_end; col_out += 8)
+  {
+    __m256d x[2], u[2], v[2];
+    pixelCenters(col_out, x[0], x[1]);
+    for (int h = 0; h < 2; h++)
+    {
+      __m256d x_a0 = _mm256_sub_pd(x[h], a0);
+      if (linear)
+      {
+        v[h] = _mm256_div_pd(_mm256_add_pd(_mm256_sub_pd(lin_y, _mm256_mul_pd(b1, x[h])), a0b1), lin_den);
+        u[h] = _mm256_div_pd(_mm256_sub_pd(x_a0, _mm256_mul_pd(a2, v[h])), a1);
+      }
+      else if (degenerate)
+      {
+        __m256d c0 = _mm256_add_pd(_mm256_mul_pd(a1, b0_y), _mm256_mul_pd(b1, x_a0));
+        __m256d c1 = _mm256_sub_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(a3, b0_y), _mm256_mul_pd(b3, x_a0)), a1b2), a2b1);
+        v[h] = _mm256_div_pd(_mm256_xor_pd(c0, _mm256_set1_pd(-0.0)), c1);
+        u[h] = _mm256_div_pd(_mm256_sub_pd(x_a0, _mm256_mul_pd(a2, v[h])), _mm256_add_pd(a1, _mm256_mul_pd(a3, v[h])));
+      }
+      else
+      {
+        __m256d c0 = _mm256_add_pd(_mm256_mul_pd(a1, b0_y), _mm256_mul_pd(b1, x_a0));
+        __m256d c1 = _mm256_sub_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(a3, b0_y), _mm256_mul_pd(b3, x_a0)), a1b2), a2b1);
+        __m256d disc = _mm256_sqrt_pd(_mm256_sub_pd(_mm256_mul_pd(c1, c1), _mm256_mul_pd(c2_4, c0)));
+        __m256d minus_c1 = _mm256_xor_pd(c1, _mm256_set1_pd(-0.0));
+        __m256d y1 = _mm256_div_pd(_mm256_add_pd(minus_c1, disc), c2_2);
+        __m256d y2 = _mm256_div_pd(_mm256_sub_pd(minus_c1, disc), c2_2);
+        __m256d x1 = _mm256_div_pd(_mm256_sub_pd(x_a0, _mm256_mul_pd(a2, y1)), _mm256_add_pd(a1, _mm256_mul_pd(a3, y1)));
+        __m256d x2 = _mm256_div_pd(_mm256_sub_pd(x_a0, _mm256_mul_pd(a2, y2)), _mm256_add_pd(a1, _mm256_mul_pd(a3, y2)));
+        // ordered compares: a NaN root stays on the first one, like the branches of invbilinear
+        __m256d outside = _mm256_or_pd(
+          _mm256_or_pd(_mm256_cmp_pd(y1, zero, _CMP_LT_OQ), _mm256_cmp_pd(y1, one, _CMP_GT_OQ)),
+          _mm256_or_pd(_mm256_cmp_pd(x1, zero, _CMP_LT_OQ), _mm256_cmp_pd(x1, one, _CMP_GT_OQ)));
+        v[h] = _mm256_blendv_pd(y1, y2, outside);
+        u[h] = _mm256_blendv_pd(x1, x2, outside);
+      }
+      u[h] = _mm256_mul_pd(u[h], width);
+      v[h] = _mm256_mul_pd(v[h], height);
+    }
+    gatherTexels(u[0], u[1], v[0], v[1], src, xres, yres, dst + col_out);
+  }
+  bilinearSpanScalar(c, row_out, col_out, col_end, src, xres, yres, dst);
+}
+
+static bool hasAVX2()
+{
+  static bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2;
+}
+
+# endif
+
+
+/*
+built with -DWARPER_CHECK_SIMD: map the span again with the scalar reference and count the pixels that differ
+*/
+template <class Scalar>
+void checkSpan(Scalar scalar, int col_begin, int col_end, const uint32_t *before, const uint32_t *dst)
+{
+  std::vector<uint32_t> reference(before, before + (col_end - col_begin));
+  scalar(&reference[0] - col_begin);
+  long mismatches = 0;
+  for (int col = col_begin; col < col_end; col++)  {mismatches += (reference[col - col_begin] != dst[col]);}
+  checked_pixels += col_end - col_begin;
+  mismatched_pixels += mismatches;
+}
+
+
+void simdCheck(long &checked, long &mismatched)
+{
+  checked = checked_pixels;
+  mismatched = mismatched_pixels;
+}
+
+
+const char *simdName()
+{
+# ifdef WARPER_X86
+  if (use_simd and hasAVX2())  {return "avx2";}
+# endif
+  return "scalar";
+}
+
+
+void projectiveSpan(const double inv[3][3], int row_out, int col_begin, int col_end,
+                    const uint32_t *src, int xres, int yres, uint32_t *dst)
+{
+# ifdef WARPER_X86
+  if (use_simd and hasAVX2())
+  {
+#   ifdef WARPER_CHECK_SIMD
+    std::vector<uint32_t> before(dst + col_begin, dst + col_end);
+    projectiveSpanAVX2(inv, row_out, col_begin, col_end, src, xres, yres, dst);
+    checkSpan([&](uint32_t *ref) {projectiveSpanScalar(inv, row_out, col_begin, col_end, src, xres, yres, ref);}, col_begin, col_end, &before[0], dst);
+#   else
+    projectiveSpanAVX2(inv, row_out, col_begin, col_end, src, xres, yres, dst);
+#   endif
+    return;
+  }
+# endif
+  projectiveSpanScalar(inv, row_out, col_begin, col_end, src, xres, yres, dst);
+}
+
+
+void bilinearSpan(const BilinearCoeffs &coeff, int row_out, int col_begin, int col_end,
+                  const uint32_t *src, int xres, int yres, uint32_t *dst)
+{
+# ifdef WARPER_X86
+  if (use_simd and hasAVX2())
+  {
+#   ifdef WARPER_CHECK_SIMD
+    std::vector<uint32_t> before(dst + col_begin, dst + col_end);
+    bilinearSpanAVX2(coeff, row_out, col_begin, col_end, src, xres, yres, dst);
+    checkSpan([&](uint32_t *ref) {bilinearSpanScalar(coeff, row_out, col_begin, col_end, src, xres, yres, ref);}, col_begin, col_end, &before[0], dst);
+#   else
+    bilinearSpanAVX2(coeff, row_out, col_begin, col_end, src, xres, yres, dst);
+#   endif
+    return;
+  }
+# endif
+  bilinearSpanScalar(coeff, row_out, col_begin, col_end, src, xres, yres, dst);
+}
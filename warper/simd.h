@@ -0,0 +1,44 @@
+/*
+Vectorized inverse mapping kernels of warper.
+A span of an output row is inverse mapped 8 pixels at a time, the RGBA texels are gathered as 32 bit words.
+AVX2 is picked at run time, other processors use the scalar loops, which stay the reference:
+both paths do the same double precision operations in the same order, so they give the same texels.
+
+Jingcong Zhang
+jingcoz@g.clemson.edu
+*/
+
+# ifndef SIMD_H
+# define SIMD_H
+
+# include <stdint.h>
+
+struct BilinearCoeffs;  // matrix.h
+
+// use the vector kernels when the processor has them, false forces the scalar reference loops
+extern bool use_simd;
+
+// instruction set used by the kernels: "avx2" or "scalar"
+const char *simdName();
+
+/*
+projective inverse map of the output pixels col_begin ... col_end - 1 of row row_out, nearest texel
+  inv is the inverse matrix, src the xres x yres input image and dst the output row, one RGBA word per pixel
+  pixels that map outside the input image keep their value
+*/
+void projectiveSpan(const double inv[3][3], int row_out, int col_begin, int col_end,
+                    const uint32_t *src, int xres, int yres, uint32_t *dst);
+
+/*
+bilinear inverse map of the same span, with the coefficients of setbilinear
+*/
+void bilinearSpan(const BilinearCoeffs &coeff, int row_out, int col_begin, int col_end,
+                  const uint32_t *src, int xres, int yres, uint32_t *dst);
+
+/*
+built with -DWARPER_CHECK_SIMD every vector span is also mapped by the scalar reference:
+number of pixels checked so far, and of those that got a different texel
+*/
+void simdCheck(long &checked, long &mismatched);
+
+# endif
@@ -8,11 +8,16 @@ The program provide two types of warp operation:
                     the output window for click is 1024x600 and then reshape the size after output image generation
 
 Usage: 
-warper input_image_name [output_image_name] [mode]
+warper input_image_name [output_image_name] [mode] [-j threads]
+warper --batch script_file [-b] [-j threads] [-cache images]
 default mode: projective mode
 mode switch:
   -b          bilinear switch - do the bilinear warp instead of a perspective warp
   -i          interactive switch
+  -j threads  number of threads of the inverse mapping, default all cores
+batch mode:
+  --batch script_file   warp every "input_image output_image matrix_commands d" record of the script, nothing is displayed
+  -cache images         number of decoded input images kept for the following records, default 16
 matrix commands:
   r theta     counter clockwise rotation about image origin, theta in degrees
   s sx sy     scale (watch out for scale by 0!)
@@ -43,13 +48,24 @@ jingcoz@g.clemson.edu
 # include <math.h>
 # include <cmath>
 # include <iomanip>
+# include <sstream>
+# include <vector>
+# include <cstring>
+# include <thread>
+# include <mutex>
 # include "matrix.h"
-
-# ifdef __APPLE__
-#   pragma clang diagnostic ignored "-Wdeprecated-declarations"
-#   include <GLUT/glut.h>
-# else
-#   include <GL/glut.h>
+# include "threadpool.h"
+# include "simd.h"
+# include "imagecache.h"
+
+// WARPER_NO_GL builds the headless warper_batch program without OpenGL and GLUT
+# ifndef WARPER_NO_GL
+#   ifdef __APPLE__
+#     pragma clang diagnostic ignored "-Wdeprecated-declarations"
+#     include <GLUT/glut.h>
+#   else
+#     include <GL/glut.h>
+#   endif
 # endif
 
 using namespace std;
@@ -67,17 +83,27 @@ static string outputImage; // output image file name
 static int xres, yres;  // input image size: width, height
 static int xres_out, yres_out;  // output image size: width, height
 static int mode;  // program mode - 0: projective warp (basic requirement), 1: bilinear warp, 2: interactive mode
+static ThreadPool *pool;  // threads of the inverse mapping, output rows are mapped in parallel
+static string batchfile;  // batch script file name, empty without batch mode
+static int cache_size;  // number of decoded input images kept in batch mode
+# ifndef WARPER_NO_GL
 static Vector2D mouseClickCorners[4];
 static int mouse_index = 0;
+# endif
 
 
 /*
 command line option parser
-warper input_image_name [output_image_name] [mode]
+warper input_image_name [output_image_name] [mode] [-j threads]
+warper --batch script_file [-b] [-j threads] [-cache images]
 default mode: projective mode
 mode switch:
   -b          bilinear switch - do the bilinear warp instead of a perspective warp
   -i          interactive switch
+  -j threads  number of threads of the inverse mapping, default all cores
+batch mode:
+  --batch script_file   warp every "input_image output_image matrix_commands d" record of the script, nothing is displayed
+  -cache images         number of decoded input images kept for the following records, default 16
 matrix commands:
   r theta     counter clockwise rotation about image origin, theta in degrees
   s sx sy     scale (watch out for scale by 0!)
@@ -92,11 +118,16 @@ void helpPrinter()
   // print help message
   cout << "Help: " << endl;
   cout << "[Usage] warper input_image_name [output_image_name] [mode]" << endl;
+  cout << "[Usage] warper --batch script_file [-b] [-j threads] [-cache images]" << endl;
   cout << "--------------------------------------------------------------" << endl;
   cout << "default mode: projective warp" << endl;
   cout << "mode switch: " << endl;
   cout << "\t-b          bilinear switch - do the bilinear warp instead of a perspective warp\n"
-       << "\t-i          interactive switch" << endl;
+       << "\t-i          interactive switch\n"
+       << "\t-j threads  number of threads of the inverse mapping, default all cores" << endl;
+  cout << "batch mode: " << endl;
+  cout << "\t--batch script_file   warp every \"input_image output_image matrix_commands d\" record of the script\n"
+       << "\t-cache images         number of decoded input images kept for the following records, default 16" << endl;
   cout << "matrix commands: " << endl;
   cout << "\tr theta     counter clockwise rotation about image origin, theta in degrees\n"
        << "\ts sx sy     scale (watch out for scale by 0!)\n"
@@ -107,15 +138,37 @@ void helpPrinter()
        << "\td           done\n" << endl;
 }
 char **getIter(char** begin, char** end, const std::string& option) {return find(begin, end, option);}
-void getCmdOptions(int argc, char **argv, string &inputImage, string &outputImage)
+string takeOption(int &argc, char **argv, const string &option)
+{
+  char **iter = getIter(argv, argv + argc, option);
+  if (iter == argv + argc)  {return "";}
+  if (iter + 1 == argv + argc)  {cout << "Missing value for option " << option << endl; exit(0);}
+  string value = iter[1];
+  for (char **p = iter; p + 2 < argv + argc; p++)  {p[0] = p[2];}
+  argc -= 2;
+  argv[argc] = NULL;
+  return value;
+}
+void getCmdOptions(int &argc, char **argv, string &inputImage, string &outputImage, int &nthreads)
 {
+  string threads = takeOption(argc, argv, "-j");
+  nthreads = (threads != "") ? atoi(threads.c_str()) : thread::hardware_concurrency();
+  batchfile = takeOption(argc, argv, "--batch");
+  string images = takeOption(argc, argv, "-cache");
+  cache_size = (images != "") ? atoi(images.c_str()) : 16;
+  mode = 0;
+  if (batchfile != "")
+  {
+    if (getIter(argv, argv + argc, "-b") != argv + argc) {mode = 1;}
+    cout << "program mode: batch " << (mode == 1 ? "bilinear" : "projective") << " warp" << endl;
+    return;
+  }
   // print help message and exit the program
   if (argc < 2)
   {
     helpPrinter();
     exit(0);
   }
-  mode = 0;
   char **iter = getIter(argv, argv + argc, "-b");
   if (iter != argv + argc)  {mode = 1;  cout << "program mode: bilinear warp" << endl;}
   else
@@ -138,26 +191,22 @@ void getCmdOptions(int argc, char **argv, string &inputImage, string &outputImag
 
 /*
 matrix command parser
-  calculate forward transform matrix
+  read matrix commands up to d from a stream into xform, return false on an unknown command or the end of the stream
+  the commands all set entries of the same matrix
 */
-void generateMatrix()
+bool readMatrix(istream &in, Matrix3D &xform)
 {
-  cout << "Please enter matrix commands: " << endl;
-  Matrix3D xform;
   char tag;
-  cin >> tag;
+  if (!(in >> tag)) {return false;}
   while (tag != 'd')
   {
-    if (tag != 'r' && tag != 's' && tag != 't' && tag != 'f' && 
-        tag != 'h' && tag != 'p' && tag != 'd') 
-    {helpPrinter(); exit(0);}
     // generate transform matrix
     switch (tag)
     {
       // rotation
       case 'r':
         double theta;
-        cin >> theta;
+        in >> theta;
         xform[0][0] = xform[1][1] = cos(theta * M_PI / 180);
         xform[0][1] = -sin(theta * M_PI / 180);
         xform[1][0] = sin(theta * M_PI / 180);
@@ -165,67 +214,80 @@ void generateMatrix()
       // scale
       case 's':
         double sx, sy;
-        cin >> sx >> sy;
+        in >> sx >> sy;
         xform[0][0] = sx;
         xform[1][1] = sy;
         break;
       // translate
       case 't':
         double dx, dy;
-        cin >> dx >> dy;
+        in >> dx >> dy;
         xform[0][2] = dx;
         xform[1][2] = dy;
         break;
       // flip: if xf = 1 flip horizontal, yf = 1 flip vertical
       case 'f':
         double xf, yf;
-        cin >> xf >> yf;
+        in >> xf >> yf;
         if (xf == 1)  {xform[0][0] = -1;}
         if (yf == 1)  {xform[1][1] = -1;}
         break;
       // shear
       case 'h':
         double hx, hy;
-        cin >> hx >> hy;
+        in >> hx >> hy;
         xform[0][1] = hx;
         xform[1][0] = hy;
         break;
       // perspective
       case 'p':
         double px, py;
-        cin >> px >> py;
+        in >> px >> py;
         xform[2][0] = px;
         xform[2][1] = py;
         break;
       default:
-        return;
+        return false;
     }
-    cin >> tag;
+    if (!(in >> tag)) {return false;}
   }
+  return true;
+}
+
+
+/*
+matrix command parser
+  calculate forward transform matrix from the commands on the standard input
+*/
+void generateMatrix()
+{
+  cout << "Please enter matrix commands: " << endl;
+  Matrix3D xform;
+  if (!readMatrix(cin, xform))  {helpPrinter(); exit(0);}
   transMatrix = xform * transMatrix;
 }
 
 
 /*
-four corners forward warp to make space for output image pixmap
+four corners forward warp of a w x h image through xform
+  gives the warped corners, the output image size and the extra translation that moves the bounding box to 0, 0
 */
-void boundingbox(Vector2D xycorners[])
+void boundingBox(const Matrix3D &xform, int w, int h, Vector2D xycorners[], int &w_out, int &h_out, Matrix3D &shift)
 {
   Vector2D u0, u1, u2, u3;
   u0.x = 0;
   u0.y = 0;
   u1.x = 0;
-  u1.y = yres;
-  u2.x = xres;
-  u2.y = yres;
-  u3.x = xres;
+  u1.y = h;
+  u2.x = w;
+  u2.y = h;
+  u3.x = w;
   u3.y = 0;
 
-  //Vector2D xy0, xy1, xy2, xy3;
-  xycorners[0] = transMatrix * u0;
-  xycorners[1] = transMatrix * u1;
-  xycorners[2] = transMatrix * u2;
-  xycorners[3] = transMatrix * u3;
+  xycorners[0] = xform * u0;
+  xycorners[1] = xform * u1;
+  xycorners[2] = xform * u2;
+  xycorners[3] = xform * u3;
 
   double x0, y0, x1, y1, x2, y2, x3, y3, x_min, x_max, y_min, y_max;
   x0 = xycorners[0].x;
@@ -242,14 +304,139 @@ void boundingbox(Vector2D xycorners[])
   x_min = min(min(x0, x1), min(x2, x3));
   y_max = max(max(y0, y1), max(y2, y3));
   y_min = min(min(y0, y1), min(y2, y3));
-  xres_out = ceil(x_max - x_min);
-  yres_out = ceil(y_max - y_min);
-  if (mode != 2)  {cout << "output image size: " << xres_out << "x" << yres_out << endl;}
+  w_out = ceil(x_max - x_min);
+  h_out = ceil(y_max - y_min);
   
   // calculate extra translation
   // extra translation transform: set x_min and y_min to 0
-  translation[0][2] = 0 - x_min;
-  translation[1][2] = 0 - y_min;
+  shift.setidentity();
+  shift[0][2] = 0 - x_min;
+  shift[1][2] = 0 - y_min;
+}
+
+
+/*
+four corners forward warp to make space for output image pixmap
+*/
+void boundingbox(Vector2D xycorners[])
+{
+  boundingBox(transMatrix, xres, yres, xycorners, xres_out, yres_out, translation);
+  if (mode != 2)  {cout << "output image size: " << xres_out << "x" << yres_out << endl;}
+}
+
+
+/*
+coefficients of a matrix for the span kernels
+*/
+void matrixCoefficients(Matrix3D m, double coefs[3][3])
+{
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++) {coefs[i][j] = m[i][j];}
+  }
+}
+
+
+/*
+output columns begin ... end - 1 of row row_out of a w_out wide output that the warped image can cover
+  the warped image lies in the convex hull of its four corners (a projective quad is convex,
+  a bilinear patch lies inside the hull of its corners), so the row center line is intersected with
+  the six segments between the corners; the span is padded by a pixel against rounding
+*/
+void coveredSpan(const Vector2D corners[4], int row_out, int w_out, int &begin, int &end)
+{
+  double y = row_out + 0.5;
+  double x_min = w_out, x_max = -1;
+  for (int i = 0; i < 4; i++)
+  {
+    for (int j = i + 1; j < 4; j++)
+    {
+      const Vector2D &p = corners[i], &q = corners[j];
+      if (y < min(p.y, q.y) || y > max(p.y, q.y)) {continue;}
+      if (p.y == q.y)
+      {
+        x_min = min(x_min, min(p.x, q.x));
+        x_max = max(x_max, max(p.x, q.x));
+        continue;
+      }
+      double x = p.x + (y - p.y) * (q.x - p.x) / (q.y - p.y);
+      x_min = min(x_min, x);
+      x_max = max(x_max, x);
+    }
+  }
+  if (x_max < x_min)  {begin = end = 0;  return;}
+  begin = max(int(floor(x_min)) - 1, 0);
+  end = min(int(ceil(x_max)) + 1, w_out);
+  if (end < begin)  {end = begin;}
+}
+
+
+/*
+inverse map every row of a w_out x h_out output pixmap through span, clipped to the part of the row the warped image covers
+  clip = false maps whole rows; the rows are cleared with memset first
+  rows: the pool that maps the rows in parallel, NULL maps them on the calling thread
+*/
+template <class Span>
+void mapRows(unsigned char *pixmap, int w_out, int h_out, const Vector2D corners[4], bool clip, ThreadPool *rows, Span span)
+{
+  auto mapRow = [&](int row_out)  // output image row
+  {
+    uint32_t *dst = (uint32_t *)pixmap + row_out * w_out;
+    int begin = 0, end = w_out;
+    if (clip) {coveredSpan(corners, row_out, w_out, begin, end);}
+    memset(dst, 0, w_out * 4);
+    span(row_out, begin, end, dst);
+  };
+  if (rows) {rows -> parallelFor(h_out, mapRow);}
+  else
+  {
+    for (int row_out = 0; row_out < h_out; row_out++) {mapRow(row_out);}
+  }
+}
+
+
+/*
+projective inverse map of a w x h input pixmap into a w_out x h_out output pixmap through the inverse of xform,
+which includes the extra translation
+  the rows are clipped to the quad of the forward mapped input corners, unless w changes sign over the input
+  image: then the warp goes through infinity and the corners do not bound the warped image
+*/
+void projectiveRows(Matrix3D xform, const unsigned char *in, int w, int h, unsigned char *out, int w_out, int h_out, ThreadPool *rows)
+{
+  double inv[3][3];
+  matrixCoefficients(xform.inverse(), inv);
+  Vector2D corners[4];
+  double u[4] = {0, 0, double(w), double(w)};
+  double v[4] = {0, double(h), double(h), 0};
+  bool clip = true;
+  for (int i = 0; i < 4; i++)
+  {
+    double hw = xform[2][0] * u[i] + xform[2][1] * v[i] + xform[2][2];
+    double hw0 = xform[2][2];
+    if (hw == 0 || (hw > 0) != (hw0 > 0)) {clip = false;  break;}
+    corners[i].x = (xform[0][0] * u[i] + xform[0][1] * v[i] + xform[0][2]) / hw;
+    corners[i].y = (xform[1][0] * u[i] + xform[1][1] * v[i] + xform[1][2]) / hw;
+  }
+  // inverse map each output row: one reciprocal per pixel along the row, 8 pixels at a time with AVX2
+  mapRows(out, w_out, h_out, corners, clip, rows, [&](int row_out, int begin, int end, uint32_t *dst)
+  {
+    projectiveSpan(inv, row_out, begin, end, (const uint32_t *)in, w, h, dst);
+  });
+}
+
+
+/*
+bilinear inverse map of a w x h input pixmap into a w_out x h_out output pixmap,
+the input corners go to the translated output corners xycorners
+*/
+void bilinearRows(Vector2D xycorners[4], const unsigned char *in, int w, int h, unsigned char *out, int w_out, int h_out, ThreadPool *rows)
+{
+  BilinearCoeffs coeff;
+  setbilinear(w, h, xycorners, coeff);
+  mapRows(out, w_out, h_out, xycorners, true, rows, [&](int row_out, int begin, int end, uint32_t *dst)
+  {
+    bilinearSpan(coeff, row_out, begin, end, (const uint32_t *)in, w, h, dst);
+  });
 }
 
 
@@ -258,9 +445,8 @@ projective warp inverse map
 */
 void inversemap()
 {
+  // output image pixmap, the rows are filled with a clear transparent color(0, 0, 0, 0) as they are mapped
   outputpixmap = new unsigned char [xres_out * yres_out * 4];
-  // fill the output image with a clear transparent color(0, 0, 0, 0)
-  for (int i = 0; i < xres_out * yres_out * 4; i++) {outputpixmap[i] = 0;}
 
   Matrix3D invMatrix;
   transMatrix = translation * transMatrix;
@@ -270,31 +456,8 @@ void inversemap()
   cout << "inverse matrix: " << endl;
   invMatrix.print();
 
-  for (int row_out = 0; row_out < yres_out; row_out++)  // output image row
-  {
-    for (int col_out = 0; col_out < xres_out; col_out++)  // output image col
-    {
-      // output coordinate
-      Vector2D xy;
-      xy.x = col_out + 0.5;
-      xy.y = row_out + 0.5;
-
-      // inverse mapping
-      double u, v;
-      u = (invMatrix * xy).x;
-      v = (invMatrix * xy).y;
-      int row_in, col_in;
-      row_in = floor(v);
-      col_in = floor(u);
-      
-      if (row_in < yres && row_in >= 0 && col_in < xres && col_in >= 0)
-      {
-        for (int k = 0; k < 4; k++)
-        {outputpixmap[(row_out * xres_out + col_out) * 4 + k] = inputpixmap[(row_in * xres + col_in) * 4 + k];}
-      }
-    }
-  }
-  cout << "Projective inverse complete." << endl;
+  projectiveRows(transMatrix, inputpixmap, xres, yres, outputpixmap, xres_out, yres_out, pool);
+  cout << "Projective inverse complete, kernels: " << simdName() << endl;
   cout << "Press Q or q to quit." << endl;
 }
 
@@ -304,42 +467,20 @@ bilinear warp inverse map
 */
 void bilinear(Vector2D xycorners[])
 {
+  // output image pixmap, the rows are filled with a clear transparent color(0, 0, 0, 0) as they are mapped
   outputpixmap = new unsigned char [xres_out * yres_out * 4];
-  // fill the output image with a clear transparent color(0, 0, 0, 0)
-  for (int i = 0; i < xres_out * yres_out * 4; i++) {outputpixmap[i] = 0;}
 
   // translate the corners
   for (int i = 0; i < 4; i++) {xycorners[i] = translation * xycorners[i];}
 
-  BilinearCoeffs coeff;
-  setbilinear(xres, yres, xycorners, coeff);
-  for (int row_out = 0; row_out < yres_out; row_out++)
-  {
-    for (int col_out = 0; col_out < xres_out; col_out++)
-    {
-      Vector2D xy, uv;
-
-      xy.x = col_out + 0.5;
-      xy.y = row_out + 0.5;
-      invbilinear(coeff, xy, uv);
-
-      int row_in, col_in;
-      row_in = floor(uv.y);
-      col_in = floor(uv.x);
-
-      if (row_in < yres && row_in >= 0 && col_in < xres && col_in >= 0)
-      {
-        for (int k = 0; k < 4; k++)
-        {outputpixmap[(row_out * xres_out + col_out) * 4 + k] = inputpixmap[(row_in * xres + col_in) * 4 + k];}
-      }
-    }
-  }
-  cout << "Bilinear inverse complete." << endl;
+  bilinearRows(xycorners, inputpixmap, xres, yres, outputpixmap, xres_out, yres_out, pool);
+  cout << "Bilinear inverse complete, kernels: " << simdName() << endl;
   cout << "Press Q or q to quit." << endl;
 }
 
 
 
+# ifndef WARPER_NO_GL
 /*
 interactive mode
   1) calculate transform matrix according to mouse click positions
@@ -386,6 +527,9 @@ void interactive()
   // refresh the output image size and calculate extra translation
   Vector2D xycorners[4];
   boundingbox(xycorners);
+  // the clicked output image size replaces the 1024x600 click window
+  delete [] outputpixmap;
+  outputpixmap = new unsigned char [xres_out * yres_out * 4];
   // add extra translation
   transMatrix = translation * transMatrix;
   cout << "interMatrix: " << endl;
@@ -395,142 +539,235 @@ void interactive()
   cout << "invinterMatrix: " << endl;
   invinterMatrix.print();
 
-  for (int row_out = 0; row_out < yres_out; row_out++)  // output image row
-  {
-    for (int col_out = 0; col_out < xres_out; col_out++)  // output image col
-    {
-      // output coordinate
-      Vector2D xy;
-      xy.x = col_out + 0.5;
-      xy.y = row_out + 0.5;
-
-      // inverse mapping
-      double u, v;
-      u = (invinterMatrix * xy).x;
-      v = (invinterMatrix * xy).y;
-      int row_in, col_in;
-      row_in = floor(v);
-      col_in = floor(u);
-      
-      if (row_in < yres && row_in >= 0 && col_in < xres && col_in >= 0)
-      {
-        for (int k = 0; k < 4; k++)
-        {outputpixmap[(row_out * xres_out + col_out) * 4 + k] = inputpixmap[(row_in * xres + col_in) * 4 + k];}
-      }
-    }
-  }
+  projectiveRows(transMatrix, inputpixmap, xres, yres, outputpixmap, xres_out, yres_out, pool);
   cout << "Interactive complete." << endl;
   // resize the window
   glutReshapeWindow(xres_out, yres_out);
   cout << "Press Q or q to quit." << endl;
 }
+# endif
 
 
 /*
-get the image pixmap
+built with -DWARPER_CHECK_SIMD: report how many pixels of the vector kernels differ from the scalar reference,
+fail if more than 1 in 10000 do (the same operations are done in the same order, so normally none do)
 */
-void readimage(string infilename)
+void checkSimd()
+{
+# ifdef WARPER_CHECK_SIMD
+  long checked, mismatched;
+  simdCheck(checked, mismatched);
+  cout << "SIMD check: " << mismatched << " of " << checked << " pixels differ from the scalar reference" << endl;
+  if (mismatched * 10000 > checked) {cerr << "SIMD kernels do not match the scalar reference" << endl;  exit(1);}
+# endif
+}
+
+
+/*
+read an image file as an RGBA pixmap of 4 bytes per pixel
+*/
+bool readRGBA(string infilename, vector<unsigned char> &pixmap, int &w, int &h, int &channels)
 {
   // read the input image and store as a pixmap
   ImageInput *in = ImageInput::open(infilename);
   if (!in)
   {
     cerr << "Cannot get the input image for " << infilename << ", error = " << geterror() << endl;
-    exit(0);
+    return false;
   }
-  else
+  // get the image size and channels information, allocate space for the image
+  const ImageSpec &spec = in -> spec();
+  w = spec.width;
+  h = spec.height;
+  channels = spec.nchannels;
+  vector<unsigned char> tmppixmap(size_t(w) * h * channels);
+  bool read = in -> read_image(TypeDesc::UINT8, &tmppixmap[0]);
+  in -> close();  // close the file
+  delete in;    // free ImageInput
+  if (!read or (channels != 1 and channels != 3 and channels != 4))
   {
-    // get the image size and channels information, allocate space for the image
-    const ImageSpec &spec = in -> spec();
-
-    xres = spec.width;
-    yres = spec.height;
-    int channels = spec.nchannels;
-    cout << "input image size: " << xres << "x" << yres << endl;
-    cout << "channels: " << channels << endl;
-
-    unsigned char tmppixmap[xres * yres * channels];
-    in -> read_image(TypeDesc::UINT8, tmppixmap);
+    cerr << "Cannot read the " << channels << " channel input image " << infilename << endl;
+    return false;
+  }
 
-    // convert input image to RGBA image
-    inputpixmap = new unsigned char [xres * yres * 4];  // input image pixel map is 4 channels
-    for (int row = 0; row < yres; row++)
+  // convert input image to RGBA image
+  pixmap.assign(size_t(w) * h * 4, 0);
+  for (int i = 0; i < w * h; i++)
+  {
+    switch (channels)
     {
-      for (int col = 0; col < xres; col++)
-      {
-        switch (channels)
-        {
-          case 1:
-            inputpixmap[(row * xres + col) * 4] = tmppixmap[row * xres + col];
-            inputpixmap[(row * xres + col) * 4 + 1] = inputpixmap[(row * xres + col) * 4];
-            inputpixmap[(row * xres + col) * 4 + 2] = inputpixmap[(row * xres + col) * 4];
-            inputpixmap[(row * xres + col) * 4 + 3] = 255;
-            break;
-          case 3:
-            for (int k = 0; k < 3; k++)
-            {inputpixmap[(row * xres + col) * 4 + k] = tmppixmap[(row * xres + col) * 3 + k];}
-            inputpixmap[(row * xres + col) * 4 + 3] = 255;
-            break;
-          case 4:
-            for (int k = 0; k < 4; k++)
-            {inputpixmap[(row * xres + col) * 4 + k] = tmppixmap[(row * xres + col) * 4 + k];}
-            break;
-          default:
-            return;
-        }
-      }
+      case 1:
+        pixmap[i * 4] = pixmap[i * 4 + 1] = pixmap[i * 4 + 2] = tmppixmap[i];
+        pixmap[i * 4 + 3] = 255;
+        break;
+      case 3:
+        for (int k = 0; k < 3; k++) {pixmap[i * 4 + k] = tmppixmap[i * 3 + k];}
+        pixmap[i * 4 + 3] = 255;
+        break;
+      case 4:
+        for (int k = 0; k < 4; k++) {pixmap[i * 4 + k] = tmppixmap[i * 4 + k];}
+        break;
     }
-
-    in -> close();  // close the file
-    delete in;    // free ImageInput
   }
+  return true;
 }
 
 
 /*
-write out the associated color image from image pixel map
+get the image pixmap
 */
-void writeimage(string outfilename)
-{   
+void readimage(string infilename)
+{
+  vector<unsigned char> pixmap;
+  int channels;
+  if (!readRGBA(infilename, pixmap, xres, yres, channels))  {exit(0);}
+  cout << "input image size: " << xres << "x" << yres << endl;
+  cout << "channels: " << channels << endl;
+  // input image pixel map is 4 channels
+  inputpixmap = new unsigned char [xres * yres * 4];
+  copy(pixmap.begin(), pixmap.end(), inputpixmap);
+}
+
+
+/*
+write out an RGBA pixmap to an image file, .ppm files get the 3 color channels
+  return false if the file cannot be created or written
+*/
+bool writeRGBA(string outfilename, const unsigned char *pixmap, int w, int h)
+{
   // create the subclass instance of ImageOutput which can write the right kind of file format
   ImageOutput *out = ImageOutput::create(outfilename);
   if (!out)
   {
     cerr << "Could not create output image for " << outfilename << ", error = " << geterror() << endl;
+    return false;
+  }
+  bool written;
+  // .ppm file: 3 channels
+  if (outfilename.substr(outfilename.find_last_of(".") + 1, outfilename.length() - 1) == "ppm")
+  {
+    vector<unsigned char> rgb(size_t(w) * h * 3);
+    for (int i = 0; i < w * h; i++)
+    {
+      for (int k = 0; k < 3; k++) {rgb[i * 3 + k] = pixmap[i * 4 + k];}
+    }
+    ImageSpec spec (w, h, 3, TypeDesc::UINT8);
+    written = out -> open(outfilename, spec) and out -> write_image(TypeDesc::UINT8, &rgb[0]);
   }
   else
-  {   
-    // open and prepare the image file
-    ImageSpec spec (xres_out, yres_out, 4, TypeDesc::UINT8);
-    out -> open(outfilename, spec);
-    // write the entire image
-    out -> write_image(TypeDesc::UINT8, outputpixmap);
-
-    // .ppm file: 3 channels
-    if (outfilename.substr(outfilename.find_last_of(".") + 1, outfilename.length() - 1) == "ppm")
+  {
+    // open and prepare the image file, then write the entire image
+    ImageSpec spec (w, h, 4, TypeDesc::UINT8);
+    written = out -> open(outfilename, spec) and out -> write_image(TypeDesc::UINT8, pixmap);
+  }
+  // close the file and free the ImageOutput I created
+  if (!out -> close())  {written = false;}
+  if (!written)  {cerr << "Could not write output image " << outfilename << ", error = " << out -> geterror() << endl;}
+  delete out;
+  return written;
+}
+
+
+/*
+write out the associated color image from image pixel map
+*/
+void writeimage(string outfilename)
+{
+  if (writeRGBA(outfilename, outputpixmap, xres_out, yres_out))  {cout << "Write the warped image to image file " << outfilename << endl;}
+}
+
+
+// one record of a batch script: warp the input image with the forward matrix xform into the output image
+struct BatchJob
+{
+  string input, output;
+  Matrix3D xform;
+};
+
+
+/*
+read a batch script: records of "input_image output_image matrix_commands d"
+  a record may span lines, the text after # on a line is a comment
+*/
+vector<BatchJob> readScript(string scriptfile)
+{
+  ifstream script(scriptfile.c_str());
+  if (!script)  {cerr << "Cannot open the batch script " << scriptfile << endl;  exit(0);}
+  // drop the comments, records are read as a stream of words
+  string line, text;
+  while (getline(script, line)) {text += line.substr(0, line.find('#')) + "\n";}
+  istringstream words(text);
+
+  vector<BatchJob> jobs;
+  BatchJob job;
+  while (words >> job.input)
+  {
+    job.xform.setidentity();
+    if (!(words >> job.output) or !readMatrix(words, job.xform))
     {
-      unsigned char pixmap[xres_out * yres_out * 3];
-      for (int row = 0; row < yres_out; row++)
+      cerr << "Bad record " << jobs.size() + 1 << " for " << job.input << " in the batch script " << scriptfile << endl;
+      exit(0);
+    }
+    jobs.push_back(job);
+  }
+  return jobs;
+}
+
+
+/*
+warp every record of a batch script, nothing is displayed
+  the records run concurrently, one per worker of the pool, each maps its rows on its own thread;
+  the decoded input images are shared through a cache of the cache_size most recently used images
+*/
+int warpBatch(const vector<BatchJob> &jobs, bool bilinear_warp, int cache_size, ThreadPool &pool)
+{
+  // an image that cannot be read is cached as a null image, the records that use it are not written
+  ImageCache cache(cache_size, [](const string &filename)
+  {
+    shared_ptr<RGBAImage> image = make_shared<RGBAImage>();
+    int channels;
+    if (!readRGBA(filename, image -> pixels, image -> width, image -> height, channels))  {return ImageCache::Image();}
+    return ImageCache::Image(image);
+  });
+  mutex print_lock;
+  int failed = 0;
+  cout << "Batch: " << jobs.size() << " records, " << pool.size() << " workers, kernels: " << simdName() << endl;
+
+  pool.parallelFor(jobs.size(), [&](int i)
+  {
+    const BatchJob &job = jobs[i];
+    ImageCache::Image in;
+    try  {in = cache.get(job.input);}
+    catch (const exception &error)  {cerr << "Cannot decode " << job.input << ": " << error.what() << endl;}
+    Vector2D corners[4];
+    int w_out = 0, h_out = 0;
+    Matrix3D shift;
+    if (in)  {boundingBox(job.xform, in -> width, in -> height, corners, w_out, h_out, shift);}
+    bool written = false;
+    if (w_out > 0 && h_out > 0)
+    {
+      vector<unsigned char> out(size_t(w_out) * h_out * 4);
+      if (bilinear_warp)
       {
-        for (int col = 0; col < xres_out; col++)
-        {
-          for (int k = 0; k < 3; k++)
-          {pixmap[(row * xres_out + col) * 3 + k] = outputpixmap[(row * xres_out + col) * 4 + k];}
-        }
+        for (int k = 0; k < 4; k++) {corners[k] = shift * corners[k];}
+        bilinearRows(corners, &in -> pixels[0], in -> width, in -> height, &out[0], w_out, h_out, NULL);
       }
-      ImageSpec spec (xres_out, yres_out, 3, TypeDesc::UINT8);
-      out -> open(outfilename, spec);
-      out -> write_image(TypeDesc::UINT8, pixmap);
+      else  {projectiveRows(shift * job.xform, &in -> pixels[0], in -> width, in -> height, &out[0], w_out, h_out, NULL);}
+      written = writeRGBA(job.output, &out[0], w_out, h_out);
     }
-
-    cout << "Write the warped image to image file " << outfilename << endl;
-    // close the file and free the ImageOutput I created
-    out -> close();
-    delete out;
-  }
+    lock_guard<mutex> guard(print_lock);
+    if (!written)  {failed++;}
+    cout << "Batch " << i + 1 << "/" << jobs.size() << ": " << job.input << " -> " << job.output << " " << w_out << "x" << h_out
+         << (written ? "" : " not written") << endl;
+  });
+  cout << "Batch complete, decoded images: " << cache.misses() << ", cache hits: " << cache.hits();
+  if (failed > 0)  {cout << ", records not written: " << failed;}
+  cout << endl;
+  return failed;
 }
 
 
+# ifndef WARPER_NO_GL
 /*
 display composed associated color image
 */
@@ -648,6 +885,7 @@ void handleReshape(int w, int h, int img_width, int img_height)
 // handleReshape_in for input window, handleReshape_out for output window: input image size may be different from output image size
 void handleReshape_in(int w, int h) {handleReshape(w, h, xres, yres);}
 void handleReshape_out(int w, int h)  {handleReshape(w, h, xres_out, yres_out);}
+# endif
 
 
 /*
@@ -656,9 +894,18 @@ Main program
 int main(int argc, char* argv[])
 {
   Vector2D xycorners[4];  // output image corner positions
+  int nthreads;  // number of threads of the inverse mapping
 
   // command line parser and calculate transform matrix
-  getCmdOptions(argc, argv, inputImage, outputImage);
+  getCmdOptions(argc, argv, inputImage, outputImage, nthreads);
+  pool = new ThreadPool(nthreads);
+  if (batchfile != "")
+  {
+    int failed = warpBatch(readScript(batchfile), mode == 1, cache_size, *pool);
+    checkSimd();
+    delete pool;
+    return (failed > 0) ? 1 : 0;
+  }
   // read input image
   readimage(inputImage);
 
@@ -672,6 +919,7 @@ int main(int argc, char* argv[])
       // get four output corner positions
       boundingbox(xycorners);
       inversemap();
+      checkSimd();
       if (outputImage != "") {writeimage(outputImage);}
       break;
 
@@ -682,11 +930,16 @@ int main(int argc, char* argv[])
       // get four output corner positions
       boundingbox(xycorners);
       bilinear(xycorners);
+      checkSimd();
       if (outputImage != "") {writeimage(outputImage);}
       break;
 
     // interactive
     case 2:
+# ifdef WARPER_NO_GL
+      cerr << "Interactive mode needs the display, use warper instead of warper_batch" << endl;
+      exit(0);
+# endif
       xres_out = 1024;
       yres_out = 600;
       outputpixmap = new unsigned char [xres_out * yres_out * 4];
@@ -699,7 +952,8 @@ int main(int argc, char* argv[])
     default:
       return 0;
   }
-  
+
+# ifndef WARPER_NO_GL
   // display input image and output image in seperated windows
   // start up the glut utilities
   glutInit(&argc, argv);
@@ -728,10 +982,12 @@ int main(int argc, char* argv[])
   // Routine that loops forever looking for events. It calls the registered
   // callback routine to handle each event that is detected
   glutMainLoop();
+# endif
 
   // release memory
   delete [] inputpixmap;
   delete [] outputpixmap;
+  delete pool;
 
   return 0;
 }